@@ -0,0 +1,47 @@
+//**************************************************************
+//
+// Region allocation.  See arena.h.
+//
+//**************************************************************
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <atomic>
+#include "arena.h"
+
+thread_local Arena arena;
+
+static std::atomic<size_t> reserved;
+
+//
+// An allocation too big to leave much of a block over gets a block of
+// its own, and the current block stays in use.
+//
+void *Arena::alloc_block(size_t n)
+{
+  size_t size = n > BLOCK / 4 ? n : BLOCK;
+  char *b = (char *)malloc(size);
+  if (b == NULL)
+    throw std::bad_alloc();
+  blocks.push_back(b);
+  reserved += size;
+  if (size == BLOCK) {
+    next = b + n;
+    limit = b + size;
+  }
+  return b;
+}
+
+Arena::~Arena()
+{
+  for (char *b : blocks)
+    free(b);
+}
+
+void print_memory_stats(std::ostream &s)
+{
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  s << "arenas: " << reserved / 1024 << " kB" << std::endl
+    << "peak RSS: " << ru.ru_maxrss << " kB" << std::endl;
+}
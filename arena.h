@@ -0,0 +1,67 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <iostream>
+#include <new>
+#include <utility>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Region allocation
+//
+//  The tree nodes, CgenNodes and the small records the code generator
+//  keeps (symbol table entries, class list cells) are never freed one
+//  by one; they live until the compiler exits.  They are carved out
+//  of large blocks instead of being allocated one by one, and a
+//  thread's blocks are all freed together when it exits.  Nothing
+//  allocated here has its destructor run.
+//
+//  Each thread has its own arena, so a method coded on a worker
+//  thread (see traverse_tree) must not leave anything allocated
+//  behind for the main thread.
+//
+//////////////////////////////////////////////////////////////////////
+
+class Arena
+{
+private:
+  std::vector<char *> blocks;
+  char *next, *limit;
+
+  void *alloc_block(size_t n);
+
+public:
+  static const size_t BLOCK = 1 << 20;
+
+  Arena() : next(NULL), limit(NULL) { }
+  ~Arena();
+
+  void *alloc(size_t n)
+  {
+    n = (n + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    if (n > size_t(limit - next))
+      return alloc_block(n);
+    void *p = next;
+    next += n;
+    return p;
+  }
+
+  template <class T, class... Args> T *make(Args &&... args)
+  {
+    return new (alloc(sizeof(T))) T(std::forward<Args>(args)...);
+  }
+};
+
+extern thread_local Arena arena;      // the calling thread's
+
+// the bytes taken by all arenas, and the peak resident set size
+void print_memory_stats(std::ostream &s);
+
+// Gives a class hierarchy operator new from the arena.
+#define ARENA_ALLOCATED                                           \
+static void *operator new(size_t n) { return arena.alloc(n); }    \
+static void operator delete(void *) { }
+
+#endif
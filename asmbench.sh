@@ -0,0 +1,37 @@
+#!/bin/bash
+#
+# Times the code generator on a generated program with many methods
+# and counts the system calls it makes writing the output (with
+# strace, if it is installed).  The methods are spread over classes
+# of 100 each and all call one another, so the output is a few tens
+# of megabytes.
+#
+#    ./asmbench.sh [cgen] [methods]
+#
+CGEN=${1:-./cgen}
+METHODS=${2:-50000}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+prog=$TMP/methods$METHODS.cl
+{
+  classes=$(( (METHODS + 99) / 100 ))
+  for ((c = 0; c < classes; c++)); do
+    echo "class C$c inherits IO {"
+    for ((m = 0; m < 100 && c * 100 + m < METHODS; m++)); do
+      echo "  m$m(x : Int) : Int { if x < $m then x + $m else m$(( m / 2 ))(x - 1) * 2 fi };"
+    done
+    echo "};"
+  done
+  echo "class Main { main() : Object { (new C0).out_int((new C0).m99(100)) }; };"
+} > $prog
+$DIR/lexer $prog | $DIR/parser | $DIR/semant > $prog.ast
+
+TIMEFORMAT="$METHODS methods: %R s"
+time $CGEN -o $TMP/out.s < $prog.ast
+echo "$(wc -c < $TMP/out.s) bytes of output"
+if command -v strace > /dev/null; then
+  strace -c -e trace=write,writev -o $TMP/strace $CGEN -o $TMP/out.s < $prog.ast
+  cat $TMP/strace
+fi
@@ -0,0 +1,61 @@
+//**************************************************************
+//
+// Output buffering.  See asmwriter.h.
+//
+//**************************************************************
+
+#include <string.h>
+#include "asmwriter.h"
+
+AsmBuf::AsmBuf(std::ostream &os, size_t size) : out(os), buf(size)
+{
+  setp(buf.data(), buf.data() + buf.size());
+}
+
+void AsmBuf::write_out()
+{
+  if (pptr() > pbase())
+    out.write(pbase(), pptr() - pbase());
+  setp(buf.data(), buf.data() + buf.size());
+}
+
+AsmBuf::int_type AsmBuf::overflow(int_type c)
+{
+  write_out();
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+    sputc(traits_type::to_char_type(c));
+  return traits_type::not_eof(c);
+}
+
+//
+// Strings are copied into the chunk; one that does not fit is
+// written out along with what came before it.
+//
+std::streamsize AsmBuf::xsputn(const char *s, std::streamsize n)
+{
+  if (n > epptr() - pptr()) {
+    write_out();
+    if (n >= epptr() - pptr()) {
+      out.write(s, n);
+      return n;
+    }
+  }
+  memcpy(pptr(), s, n);
+  pbump(n);
+  return n;
+}
+
+int AsmBuf::sync()
+{
+  return 0;
+}
+
+AsmWriter::AsmWriter(std::ostream &os, size_t size) : std::ostream(NULL), buf(os, size)
+{
+  rdbuf(&buf);
+}
+
+AsmWriter::~AsmWriter()
+{
+  buf.write_out();
+}
@@ -0,0 +1,48 @@
+#ifndef ASMWRITER_H
+#define ASMWRITER_H
+
+#include <iostream>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Output buffering
+//
+//  The emitters end every line with endl, which would flush the
+//  output stream once per instruction.  An AsmWriter is an ostream
+//  that collects the generated code in large chunks instead and
+//  passes each one on to the real output with a single write; endl
+//  and flush only end the line.  Whatever is left is written out
+//  when the writer is destroyed.
+//
+//////////////////////////////////////////////////////////////////////
+
+class AsmBuf : public std::streambuf
+{
+private:
+  std::ostream &out;
+  std::vector<char> buf;
+
+protected:
+  int_type overflow(int_type c);
+  std::streamsize xsputn(const char *s, std::streamsize n);
+  int sync();                     // does not write anything
+
+public:
+  AsmBuf(std::ostream &os, size_t size);
+  void write_out();
+};
+
+class AsmWriter : public std::ostream
+{
+private:
+  AsmBuf buf;
+
+public:
+  static const size_t CHUNK = 1 << 20;
+
+  AsmWriter(std::ostream &os, size_t size = CHUNK);
+  ~AsmWriter();
+};
+
+#endif
@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# Compares loading the text and the binary AST of a generated program
+# with many methods.  Both runs convert their input to the binary
+# format (COOL_TARGET=ast), so they do the same work apart from
+# reading the input.
+#
+#    ./astbench.sh [cgen] [methods]
+#
+CGEN=${1:-./cgen}
+METHODS=${2:-50000}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+prog=$TMP/methods$METHODS.cl
+{
+  classes=$(( (METHODS + 99) / 100 ))
+  for ((c = 0; c < classes; c++)); do
+    echo "class C$c inherits IO {"
+    for ((m = 0; m < 100 && c * 100 + m < METHODS; m++)); do
+      echo "  m$m(x : Int) : Int { let y : Int <- x * $m in if y < $m then \"s$m\".length() + y else m$(( m / 2 ))(y - 1) fi };"
+    done
+    echo "};"
+  done
+  echo "class Main { main() : Object { (new C0).out_int((new C0).m99(100)) }; };"
+} > $prog
+$DIR/lexer $prog | $DIR/parser | $DIR/semant > $TMP/text.ast
+COOL_TARGET=ast $CGEN -o $TMP/binary.ast < $TMP/text.ast
+
+for f in text binary; do
+  TIMEFORMAT="$f: $(wc -c < $TMP/$f.ast) bytes, loaded in %R s"
+  time COOL_TARGET=ast $CGEN -o $TMP/out.ast < $TMP/$f.ast
+done
@@ -0,0 +1,594 @@
+//**************************************************************
+//
+// Binary AST format: writing, and loading in place of the text
+// parser.  See astbin.h.
+//
+//**************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include "astbin.h"
+#include "cgen.h"
+
+extern int node_lineno;
+extern Program ast_root;
+
+///////////////////////////////////////////////////////////////////////
+//
+// Writing
+//
+///////////////////////////////////////////////////////////////////////
+
+AstWriter::AstWriter(std::ostream &os) : out(os), constants(NULL)
+{
+  out.write(AST_MAGIC, strlen(AST_MAGIC));
+  out.put(AST_VERSION);
+  table(idtable);
+  table(stringtable);
+  table(inttable);
+}
+
+AstWriter::AstWriter(std::ostream &os, const std::unordered_map<Symbol, unsigned> &c)
+  : out(os), constants(&c)
+{
+}
+
+//
+// StringTable only looks entries up by index by walking its list,
+// which makes writing the tables quadratic in their size; writing
+// happens once per program, loading is what has to be fast.
+//
+template <class Elem> void AstWriter::table(StringTable<Elem> &t)
+{
+  int count = 0;
+  for (int i = t.first(); t.more(i); i = t.next(i))
+    count++;
+  num(count);
+  for (int i = t.first(); t.more(i); i = t.next(i)) {
+    Elem *e = t.lookup(i);
+    unsigned index = symbols.size() + 1;
+    symbols[e] = index;
+    num(e->get_len());
+    out.write(e->get_string(), e->get_len());
+  }
+}
+
+void AstWriter::num(unsigned n)
+{
+  while (n >= 0x80) {
+    out.put(char(n | 0x80));
+    n >>= 7;
+  }
+  out.put(char(n));
+}
+
+void AstWriter::sym(Symbol s)
+{
+  if (constants == NULL || s == NULL) {
+    num(s ? symbols.at(s) : 0);
+    return;
+  }
+  num(s->get_len() + 1);
+  out.write(s->get_string(), s->get_len());
+  auto c = constants->find(s);
+  num(c == constants->end() ? 0 : c->second + 1);
+}
+
+void AstWriter::node(AstKind k, tree_node *n)
+{
+  num(k);
+  num(n->get_line_number());
+}
+
+void AstWriter::expr(AstKind k, Expression_class *e)
+{
+  node(k, e);
+  sym(e->get_type());
+}
+
+void program_class::dump_binary(AstWriter &w)
+{
+  w.node(AST_PROGRAM, this);
+  w.list(classes);
+}
+
+void class__class::dump_binary(AstWriter &w)
+{
+  w.node(AST_CLASS, this);
+  w.sym(name);
+  w.sym(parent);
+  w.list(features);
+  w.sym(filename);
+}
+
+void method_class::dump_binary(AstWriter &w)
+{
+  w.node(AST_METHOD, this);
+  w.sym(name);
+  w.list(formals);
+  w.sym(return_type);
+  expr->dump_binary(w);
+}
+
+void attr_class::dump_binary(AstWriter &w)
+{
+  w.node(AST_ATTR, this);
+  w.sym(name);
+  w.sym(type_decl);
+  init->dump_binary(w);
+}
+
+void formal_class::dump_binary(AstWriter &w)
+{
+  w.node(AST_FORMAL, this);
+  w.sym(name);
+  w.sym(type_decl);
+}
+
+void branch_class::dump_binary(AstWriter &w)
+{
+  w.node(AST_BRANCH, this);
+  w.sym(name);
+  w.sym(type_decl);
+  expr->dump_binary(w);
+}
+
+void assign_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_ASSIGN, this);
+  w.sym(name);
+  expr->dump_binary(w);
+}
+
+void static_dispatch_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_STATIC_DISPATCH, this);
+  expr->dump_binary(w);
+  w.sym(type_name);
+  w.sym(name);
+  w.list(actual);
+}
+
+void dispatch_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_DISPATCH, this);
+  expr->dump_binary(w);
+  w.sym(name);
+  w.list(actual);
+}
+
+void cond_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_COND, this);
+  pred->dump_binary(w);
+  then_exp->dump_binary(w);
+  else_exp->dump_binary(w);
+}
+
+void loop_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_LOOP, this);
+  pred->dump_binary(w);
+  body->dump_binary(w);
+}
+
+void typcase_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_TYPCASE, this);
+  expr->dump_binary(w);
+  w.list(cases);
+}
+
+void block_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_BLOCK, this);
+  w.list(body);
+}
+
+void let_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_LET, this);
+  w.sym(identifier);
+  w.sym(type_decl);
+  init->dump_binary(w);
+  body->dump_binary(w);
+}
+
+#define DUMP_BINARY_ARITH(name, kind)          \
+void name##_class::dump_binary(AstWriter &w)   \
+{                                              \
+  w.expr(kind, this);                          \
+  e1->dump_binary(w);                          \
+  e2->dump_binary(w);                          \
+}
+
+DUMP_BINARY_ARITH(plus, AST_PLUS)
+DUMP_BINARY_ARITH(sub, AST_SUB)
+DUMP_BINARY_ARITH(mul, AST_MUL)
+DUMP_BINARY_ARITH(divide, AST_DIVIDE)
+DUMP_BINARY_ARITH(lt, AST_LT)
+DUMP_BINARY_ARITH(eq, AST_EQ)
+DUMP_BINARY_ARITH(leq, AST_LEQ)
+
+void neg_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_NEG, this);
+  e1->dump_binary(w);
+}
+
+void comp_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_COMP, this);
+  e1->dump_binary(w);
+}
+
+void int_const_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_INT_CONST, this);
+  w.sym(token);
+}
+
+void bool_const_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_BOOL_CONST, this);
+  w.num(val ? 1 : 0);
+}
+
+void string_const_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_STRING_CONST, this);
+  w.sym(token);
+}
+
+void new__class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_NEW, this);
+  w.sym(type_name);
+}
+
+void isvoid_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_ISVOID, this);
+  e1->dump_binary(w);
+}
+
+void no_expr_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_NO_EXPR, this);
+}
+
+void object_class::dump_binary(AstWriter &w)
+{
+  w.expr(AST_OBJECT, this);
+  w.sym(name);
+}
+
+///////////////////////////////////////////////////////////////////////
+//
+// Loading
+//
+// The reader builds the tree with the cool-tree.h constructors, just
+// as the text parser does, setting node_lineno before each one.
+//
+///////////////////////////////////////////////////////////////////////
+
+class AstReader
+{
+private:
+  const unsigned char *p, *end;
+  std::vector<Symbol> symbols;
+
+  void fail();
+  template <class Elem> void table(StringTable<Elem> &t);
+
+public:
+  AstReader(const unsigned char *data, size_t size);
+
+  unsigned num();
+  Symbol sym();
+  AstKind node();                   // reads the kind and the line number
+  Symbol type() { return sym(); }
+
+  Program program();
+  Class_ class_();
+  Feature feature();
+  Formal formal();
+  Case branch();
+  Expression expr();
+
+  template <class Elem> list_node<Elem> *list(Elem (AstReader::*elem)())
+  {
+    list_node<Elem> *l = list_node<Elem>::nil();
+    for (unsigned n = num(); n > 0; n--)
+      l = list_node<Elem>::append(l, list_node<Elem>::single((this->*elem)()));
+    return l;
+  }
+};
+
+AstReader::AstReader(const unsigned char *data, size_t size) : p(data), end(data + size)
+{
+  size_t header = strlen(AST_MAGIC);
+  if (size <= header || memcmp(p, AST_MAGIC, header) != 0 || p[header] != AST_VERSION)
+    fail();
+  p += header + 1;
+  table(idtable);
+  table(stringtable);
+  table(inttable);
+}
+
+void AstReader::fail()
+{
+  cerr << "cgen: malformed binary AST" << endl;
+  exit(1);
+}
+
+template <class Elem> void AstReader::table(StringTable<Elem> &t)
+{
+  std::string s;
+  for (unsigned n = num(); n > 0; n--) {
+    unsigned len = num();
+    if (len > size_t(end - p))
+      fail();
+    s.assign((const char *)p, len);
+    p += len;
+    symbols.push_back(t.add_string(&s[0], len));
+  }
+}
+
+unsigned AstReader::num()
+{
+  unsigned n = 0;
+  for (int shift = 0; ; shift += 7) {
+    if (p == end || shift > 28)
+      fail();
+    unsigned char c = *p++;
+    n |= unsigned(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return n;
+  }
+}
+
+Symbol AstReader::sym()
+{
+  unsigned i = num();
+  if (i > symbols.size())
+    fail();
+  return i ? symbols[i - 1] : NULL;
+}
+
+AstKind AstReader::node()
+{
+  AstKind k = AstKind(num());
+  node_lineno = num();
+  return k;
+}
+
+Program AstReader::program()
+{
+  if (node() != AST_PROGRAM)
+    fail();
+  int line = node_lineno;
+  Classes classes = list(&AstReader::class_);
+  node_lineno = line;
+  return ::program(classes);
+}
+
+Class_ AstReader::class_()
+{
+  if (node() != AST_CLASS)
+    fail();
+  int line = node_lineno;
+  Symbol name = sym();
+  Symbol parent = sym();
+  Features features = list(&AstReader::feature);
+  Symbol filename = sym();
+  node_lineno = line;
+  return ::class_(name, parent, features, filename);
+}
+
+Feature AstReader::feature()
+{
+  AstKind k = node();
+  int line = node_lineno;
+  Symbol name = sym();
+  if (k == AST_METHOD) {
+    Formals formals = list(&AstReader::formal);
+    Symbol return_type = sym();
+    Expression body = expr();
+    node_lineno = line;
+    return method(name, formals, return_type, body);
+  }
+  if (k != AST_ATTR)
+    fail();
+  Symbol type_decl = sym();
+  Expression init = expr();
+  node_lineno = line;
+  return attr(name, type_decl, init);
+}
+
+Formal AstReader::formal()
+{
+  if (node() != AST_FORMAL)
+    fail();
+  Symbol name = sym();
+  Symbol type_decl = sym();
+  return ::formal(name, type_decl);
+}
+
+Case AstReader::branch()
+{
+  if (node() != AST_BRANCH)
+    fail();
+  int line = node_lineno;
+  Symbol name = sym();
+  Symbol type_decl = sym();
+  Expression body = expr();
+  node_lineno = line;
+  return ::branch(name, type_decl, body);
+}
+
+//
+// The fields are read into locals first: C++ leaves the order in which
+// arguments are evaluated unspecified.
+//
+Expression AstReader::expr()
+{
+  AstKind k = node();
+  int line = node_lineno;
+  Symbol t = type();
+  Expression e, e1, e2, e3;
+  Symbol s1, s2;
+  Expressions es;
+
+  switch (k) {
+  case AST_ASSIGN:
+    s1 = sym();
+    e1 = expr();
+    node_lineno = line;
+    e = assign(s1, e1);
+    break;
+  case AST_STATIC_DISPATCH:
+    e1 = expr();
+    s1 = sym();
+    s2 = sym();
+    es = list(&AstReader::expr);
+    node_lineno = line;
+    e = static_dispatch(e1, s1, s2, es);
+    break;
+  case AST_DISPATCH:
+    e1 = expr();
+    s1 = sym();
+    es = list(&AstReader::expr);
+    node_lineno = line;
+    e = dispatch(e1, s1, es);
+    break;
+  case AST_COND:
+    e1 = expr();
+    e2 = expr();
+    e3 = expr();
+    node_lineno = line;
+    e = cond(e1, e2, e3);
+    break;
+  case AST_LOOP:
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    e = loop(e1, e2);
+    break;
+  case AST_TYPCASE: {
+    e1 = expr();
+    Cases cases = list(&AstReader::branch);
+    node_lineno = line;
+    e = typcase(e1, cases);
+    break;
+  }
+  case AST_BLOCK:
+    es = list(&AstReader::expr);
+    node_lineno = line;
+    e = block(es);
+    break;
+  case AST_LET:
+    s1 = sym();
+    s2 = sym();
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    e = let(s1, s2, e1, e2);
+    break;
+  case AST_PLUS: case AST_SUB: case AST_MUL: case AST_DIVIDE:
+  case AST_LT: case AST_EQ: case AST_LEQ:
+    e1 = expr();
+    e2 = expr();
+    node_lineno = line;
+    switch (k) {
+    case AST_PLUS:   e = plus(e1, e2); break;
+    case AST_SUB:    e = sub(e1, e2); break;
+    case AST_MUL:    e = mul(e1, e2); break;
+    case AST_DIVIDE: e = divide(e1, e2); break;
+    case AST_LT:     e = lt(e1, e2); break;
+    case AST_EQ:     e = eq(e1, e2); break;
+    default:         e = leq(e1, e2); break;
+    }
+    break;
+  case AST_NEG:
+    e1 = expr();
+    node_lineno = line;
+    e = neg(e1);
+    break;
+  case AST_COMP:
+    e1 = expr();
+    node_lineno = line;
+    e = comp(e1);
+    break;
+  case AST_ISVOID:
+    e1 = expr();
+    node_lineno = line;
+    e = isvoid(e1);
+    break;
+  case AST_INT_CONST:
+    e = int_const(sym());
+    break;
+  case AST_BOOL_CONST:
+    e = bool_const(num() != 0);
+    break;
+  case AST_STRING_CONST:
+    e = string_const(sym());
+    break;
+  case AST_NEW:
+    e = new_(sym());
+    break;
+  case AST_NO_EXPR:
+    e = no_expr();
+    break;
+  case AST_OBJECT:
+    e = object(sym());
+    break;
+  default:
+    fail();
+  }
+  return e->set_type(t);
+}
+
+//
+// cgen is linked with --wrap=_Z11ast_yyparsev, so the call to
+// ast_yyparse() in the course's cgen-phase.cc comes here.  The basic
+// classes are built first.  Input that starts with the magic byte is
+// then loaded, mapped if it is a file and read in one go otherwise;
+// anything else goes to the text parser.
+//
+extern "C" int __real__Z11ast_yyparsev();
+
+extern "C" int __wrap__Z11ast_yyparsev()
+{
+  prepare_basic_classes();
+  int c = getc(stdin);
+  ungetc(c, stdin);
+  if (c != AST_MAGIC[0])
+    return __real__Z11ast_yyparsev();
+
+  struct stat st;
+  if (fstat(fileno(stdin), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(stdin), 0);
+    if (data != MAP_FAILED) {
+      ast_root = AstReader((const unsigned char *)data, st.st_size).program();
+      munmap(data, st.st_size);
+      return 0;
+    }
+  }
+
+  std::vector<unsigned char> buf;
+  size_t n = 0;
+  buf.resize(1 << 20);
+  while (size_t got = fread(&buf[n], 1, buf.size() - n, stdin)) {
+    n += got;
+    if (n == buf.size())
+      buf.resize(2 * n);
+  }
+  ast_root = AstReader(buf.data(), n).program();
+  return 0;
+}
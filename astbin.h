@@ -0,0 +1,84 @@
+#ifndef ASTBIN_H
+#define ASTBIN_H
+
+#include <iostream>
+#include <unordered_map>
+#include "cool-tree.h"
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Binary AST format
+//
+//  The text dump that semant writes has to be lexed and parsed again
+//  on the way into cgen.  The same tree can also be kept in a compact
+//  binary form, which cgen loads with one read (or an mmap) and no
+//  parsing:
+//
+//     magic       "\177COOLAST" and a version byte
+//     tables      idtable, stringtable and inttable in index order:
+//                 a count, then the length and bytes of each entry
+//     tree        the program, in preorder
+//
+//  All numbers are unsigned LEB128.  A node is its AstKind and line
+//  number, followed (for an expression) by its type, then by its
+//  fields in the order of the cool-tree.h constructors.  A symbol is
+//  its index counting through the three tables in that order, plus
+//  one; 0 is NULL.  A list is its length and then its elements.
+//
+//  The tables are written in index order and read back in the same
+//  order, into tables holding only what prepare_basic_classes put
+//  there (which the file starts with too), so every symbol gets the
+//  index it had when the file was written and the generated code is
+//  the same for either format.
+//
+//  `COOL_TARGET=ast cgen' writes the binary form of its input.  cgen
+//  is linked with the parser wrapped, and reads either format.
+//
+//  The code cache (codecache.h) writes classes the same way to make
+//  their keys, but with no header or tables: a symbol is its length
+//  plus one and its text, then the number of its constant's label plus
+//  one, 0 if it is not a string or integer constant.
+//
+//////////////////////////////////////////////////////////////////////
+
+#define AST_MAGIC "\177COOLAST"
+#define AST_VERSION 1
+
+enum AstKind
+{
+  AST_PROGRAM, AST_CLASS, AST_METHOD, AST_ATTR, AST_FORMAL, AST_BRANCH,
+  AST_ASSIGN, AST_STATIC_DISPATCH, AST_DISPATCH, AST_COND, AST_LOOP,
+  AST_TYPCASE, AST_BLOCK, AST_LET, AST_PLUS, AST_SUB, AST_MUL, AST_DIVIDE,
+  AST_NEG, AST_LT, AST_EQ, AST_LEQ, AST_COMP, AST_INT_CONST, AST_BOOL_CONST,
+  AST_STRING_CONST, AST_NEW, AST_ISVOID, AST_NO_EXPR, AST_OBJECT
+};
+
+class AstWriter
+{
+private:
+  std::ostream &out;
+  std::unordered_map<Symbol, unsigned> symbols;
+  const std::unordered_map<Symbol, unsigned> *constants;    // for keys
+
+  template <class Elem> void table(StringTable<Elem> &t);
+
+public:
+  AstWriter(std::ostream &os);      // writes the header and the tables
+
+  // writes keys; constants numbers the string and integer constants
+  AstWriter(std::ostream &os, const std::unordered_map<Symbol, unsigned> &constants);
+
+  void num(unsigned n);
+  void sym(Symbol s);
+  void node(AstKind k, tree_node *n);
+  void expr(AstKind k, Expression_class *e);
+
+  template <class Elem> void list(list_node<Elem> *l)
+  {
+    num(l->len());
+    for (int i = l->first(); l->more(i); i = l->next(i))
+      l->nth(i)->dump_binary(*this);
+  }
+};
+
+#endif
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Times rebuilding a generated program with many classes from the code
+# cache (see codecache.h) after one of its classes is edited.  The
+# program is compiled once without the cache, once to fill it, again
+# unchanged, and again with one method body changed; each cached run
+# reports the entries it had to add, which are its misses.
+#
+#    ./cachebench.sh [cgen] [classes]
+#
+CGEN=${1:-./cgen}
+CLASSES=${2:-2000}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+gen() {
+  echo "class C0 inherits IO { f(x : Int) : Int { x }; g(o : Object) : Int { 0 }; };"
+  for ((i = 1; i < CLASSES; i++)); do
+    op=+
+    [ $i = $1 ] && op=-
+    echo "class C$i inherits C$(( (i - 1) / 2 )) {"
+    echo "  a$i : Int <- $i;"
+    echo "  f(x : Int) : Int { let y : Int <- x $op a$i in if y < 10 then g(self) else f(y - 10) fi };"
+    echo "  g(o : Object) : Int { case o of c : C$i => f(1); c0 : C0 => 0; o : Object => 3; esac };"
+    echo "};"
+  done
+  echo "class Main { main() : Object { (new C$((CLASSES - 1))).f(0) }; };"
+}
+# the file name is in the code, so the edit is to the same file; the
+# binary AST keeps parsing out of the times
+for p in prog edited; do
+  gen $([ $p = prog ] && echo 0 || echo $(( CLASSES / 2 ))) > $TMP/prog.cl
+  $DIR/lexer $TMP/prog.cl | $DIR/parser | $DIR/semant | COOL_TARGET=ast $CGEN -o $TMP/$p.ast
+done
+
+TIMEFORMAT="no cache: %R s"
+time $CGEN -o $TMP/out.s < $TMP/prog.ast
+for run in "cold prog" "warm prog" "edited edited"; do
+  set -- $run
+  before=$(ls $TMP/cache 2>/dev/null | wc -l)
+  TIMEFORMAT="$1: %R s"
+  time COOL_CACHE=$TMP/cache $CGEN -o $TMP/$1.s < $TMP/$2.ast
+  echo "  $(( $(ls $TMP/cache | wc -l) - before )) of $(( CLASSES + 6 )) classes coded"
+done
@@ -23,18 +23,40 @@
 //**************************************************************
 
 #include <algorithm>
+#include <climits>
 #include <map>
+#include <memory>
 #include <queue>
 #include <stack>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include "asmwriter.h"
+#include "astbin.h"
 #include "cgen.h"
 #include "cgen_gc.h"
+#include "codecache.h"
+#include "peephole.h"
+#include <sstream>
 #include <string>
 #include <tuple>
 
 extern void emit_string_constant(ostream &str, char *s);
 extern int cgen_debug;
-int label_index = 0;
-std::map<Symbol, CgenNodeP> sym_node;
+extern int cgen_optimize;
+extern int node_lineno;
+extern int disable_reg_alloc;
+//
+// Labels are numbered in sequence.  While a class's methods are coded
+// (on one of the traverse_tree workers), the numbers start again at 0
+// and the label names carry the class's tag as well.
+//
+thread_local int label_index = 0;
+thread_local int label_space = -1;
+std::unordered_map<Symbol, CgenNodeP> sym_node;
+Target cgen_target = TARGET_MIPS;
+#define DEFAULT_INLINE_SIZE 10
+int cgen_inline = DEFAULT_INLINE_SIZE;
 
 //
 // Three symbols from the semantic analyzer (semant.cc) are used.
@@ -138,13 +160,34 @@ BoolConst truebool(TRUE);
 
 void program_class::cgen(ostream &os)
 {
-  // spim wants comments to start with '#'
-  os << "# start of generated code\n";
+  // The flags are parsed by the course's handle_flags.cc, so the
+  // target is picked from the environment.
+  const char *target = getenv("COOL_TARGET");
+  if (target && strcmp(target, "x86_64") == 0)
+    cgen_target = TARGET_X86_64;
+  else if (target && strcmp(target, "c") == 0)
+    cgen_target = TARGET_C;
+  const char *inline_size = getenv("COOL_INLINE");
+  if (inline_size)
+    cgen_inline = atoi(inline_size);
+
+  AsmWriter out(os);
+
+  // COOL_TARGET=ast converts the input to the binary AST format
+  if (target && strcmp(target, "ast") == 0) {
+    AstWriter w(out);
+    dump_binary(w);
+    return;
+  }
+
+  // spim and gas both take comments starting with '#'
+  const char *comment = cgen_target == TARGET_C ? "//" : "#";
+  out << comment << " start of generated code\n";
 
   initialize_constants();
-  CgenClassTable *codegen_classtable = new CgenClassTable(classes, os);
+  CgenClassTable *codegen_classtable = new CgenClassTable(classes, out);
 
-  os << "\n# end of generated code\n";
+  out << "\n" << comment << " end of generated code\n";
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -254,6 +297,26 @@ static void emit_sll(char *dest, char *src1, int num, ostream &s)
   s << SLL << dest << " " << src1 << " " << num << endl;
 }
 
+static void emit_xori(char *dest, char *src1, int imm, ostream &s)
+{
+  s << XORI << dest << " " << src1 << " " << imm << endl;
+}
+
+static void emit_slt(char *dest, char *src1, char *src2, ostream &s)
+{
+  s << SLT << dest << " " << src1 << " " << src2 << endl;
+}
+
+static void emit_sle(char *dest, char *src1, char *src2, ostream &s)
+{
+  s << SLE << dest << " " << src1 << " " << src2 << endl;
+}
+
+static void emit_seq(char *dest, char *src1, char *src2, ostream &s)
+{
+  s << SEQ << dest << " " << src1 << " " << src2 << endl;
+}
+
 static void emit_jalr(char *dest, ostream &s)
 {
   s << JALR << "\t" << dest << endl;
@@ -264,6 +327,16 @@ static void emit_jal(char *address, ostream &s)
   s << JAL << address << endl;
 }
 
+static void emit_jump(char *address, ostream &s)
+{
+  s << J << address << endl;
+}
+
+static void emit_jr(char *dest, ostream &s)
+{
+  s << JR << dest << endl;
+}
+
 static void emit_return(ostream &s)
 {
   s << RET << endl;
@@ -284,9 +357,12 @@ static void emit_init_ref(Symbol sym, ostream &s)
   s << sym << CLASSINIT_SUFFIX;
 }
 
-static void emit_label_ref(int l, ostream &s)
+void emit_label_ref(int l, ostream &s)
 {
-  s << "label" << l;
+  s << "label";
+  if (label_space >= 0)
+    s << label_space << "_";
+  s << l;
 }
 
 static void emit_protobj_ref(Symbol sym, ostream &s)
@@ -340,6 +416,13 @@ static void emit_blt(char *src1, char *src2, int label, ostream &s)
   s << endl;
 }
 
+static void emit_bge(char *src1, char *src2, int label, ostream &s)
+{
+  s << BGE << src1 << " " << src2 << " ";
+  emit_label_ref(label, s);
+  s << endl;
+}
+
 static void emit_blti(char *src1, int imm, int label, ostream &s)
 {
   s << BLT << src1 << " " << imm << " ";
@@ -406,6 +489,705 @@ static void emit_gc_check(char *source, ostream &s)
   s << JAL << "_gc_check" << endl;
 }
 
+//
+// Method and init bodies are generated into a buffer first; with -O
+// the peephole pass cleans them up before they are written out.
+//
+static void emit_body(const std::string &code, ostream &s)
+{
+  if (!cgen_optimize) {
+    s << code;
+    return;
+  }
+  InsnBuffer body;
+  body.append(code);
+  body.peephole();
+  body.print(s);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Frames
+//
+// On entry to a method its arguments are on the stack, the first one
+// deepest, and the callee pops them on return.  FP is set to the
+// caller's SP, so argument k of n is at FP + 4*(n-k).  Below FP are the
+// saved FP, SELF and RA, then the callee-saved registers the method
+// uses, then the stack slots of the values that didn't get a register.
+//
+//      FP + 4n       first argument
+//      ...
+//      FP + 4        last argument
+//      FP            saved FP
+//      FP - 4        saved SELF
+//      FP - 8        saved RA
+//      FP - 12       saved $s1
+//      ...
+//                    slot 0
+//      ...
+//
+// The virtual registers of a function get their homes from
+// allocate_registers (ir.cc): a register of either pool in emit.h, a
+// slot, or nothing for constants, which are loaded where they are
+// used.  -r (disable_reg_alloc) keeps every value in a slot.  The
+// collectors only find the objects on the stack, so with one no value
+// is kept in a callee-saved register across a call either.  They also
+// take any word on the stack that points into the heap for an object,
+// so with one no raw word goes in a slot: -r leaves the caller-saved
+// registers to the words, and a word that is live across a call is
+// kept boxed.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static char *caller_regs[NUM_CALLER_REGS] =
+    {"$t0", "$t3", "$t4", "$t5", "$t6", "$t7", "$t8", "$t9"};
+static char *callee_regs[NUM_CALLEE_REGS] = {"$s1", "$s2", "$s3", "$s4", "$s5", "$s6"};
+
+//
+// Lowering of an IRFunction to MIPS.  Each IR instruction becomes a
+// few instructions working on the registers of its operands; operands
+// that live in a slot or are constants are first loaded into one of
+// the scratch registers.  A comparison used only by the branch that
+// follows it is folded into the branch, and a jump or branch to the
+// next block falls through.
+//
+class MipsLowering
+{
+private:
+  IRFunction &fn;
+  IRAlloc alloc;
+  StringEntry *filename;          // for run-time errors
+  std::vector<int> labels;        // of each block
+  std::vector<bool> referenced;   // whether a block's label is used
+  int block;                      // the block being lowered
+  std::ostringstream tables;      // the jump tables of switches, as data
+
+  int frame_size() { return 3 + alloc.callee_used + alloc.slots; }
+  int home_offset(int v);
+  bool const_imm(int v, int &imm);
+  char *use(int v, char *scratch, ostream &s);
+  char *target(int v, char *scratch);
+  void define(int v, char *reg, ostream &s);
+  void label_ref(int b, ostream &s);
+
+  void code_prologue(ostream &s);
+  void code_epilogue(ostream &s);
+  void code_void_check(char *reg, int line, ostream &s);
+  void code_call(const IRInsn &in, ostream &s);
+  bool args_in_place(const IRInsn &in);
+  void code_tail_call(const IRInsn &in, bool in_place, ostream &s);
+  void code_new(const IRInsn &in, ostream &s);
+  void code_cond(const IRInsn *cmp, int cond, bool negate, int b, ostream &s);
+  void code_branch(const IRInsn *cmp, const IRInsn &br, ostream &s);
+  void code_switch(const IRInsn &in, ostream &s);
+  void code_insn(const IRInsn &in, ostream &s);
+
+public:
+  MipsLowering(IRFunction &f, CgenNodeP curr);
+  void code(ostream &s);
+};
+
+MipsLowering::MipsLowering(IRFunction &f, CgenNodeP curr) : fn(f), block(0)
+{
+  // words stay off the stack for a collector, so they need registers even with -r
+  bool gc = cgen_Memmgr != GC_NOGC;
+  int caller = (disable_reg_alloc && !gc) ? 0 : NUM_CALLER_REGS;
+  int callee = (disable_reg_alloc || gc) ? 0 : NUM_CALLEE_REGS;
+  allocate_registers(fn, caller, callee, !gc, alloc);
+  filename = stringtable.lookup_string(curr->get_filename()->get_string());
+  for (size_t b = 0; b < fn.blocks.size(); b++)
+    labels.push_back(label_index++);
+  referenced.assign(fn.blocks.size(), false);
+}
+
+// Offset from FP, in words, of a value kept in a slot or argument.
+int MipsLowering::home_offset(int v)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_ARG)
+    return fn.nargs - h.index;
+  return -(3 + alloc.callee_used + h.index);
+}
+
+bool MipsLowering::const_imm(int v, int &imm)
+{
+  if (alloc.homes[v].kind != HOME_CONST || alloc.const_def[v]->op != IR_LI)
+    return false;
+  imm = alloc.const_def[v]->imm;
+  return true;
+}
+
+// The register holding v, loading it into scratch if it has none.
+char *MipsLowering::use(int v, char *scratch, ostream &s)
+{
+  const IRHome &h = alloc.homes[v];
+  switch (h.kind) {
+  case HOME_SELF:
+    return SELF;
+  case HOME_CALLER:
+    return caller_regs[h.index];
+  case HOME_CALLEE:
+    return callee_regs[h.index];
+  case HOME_CONST: {
+    const IRInsn *c = alloc.const_def[v];
+    if (c->op == IR_LA)
+      emit_load_address(scratch, (char *)c->label.c_str(), s);
+    else if (c->imm == 0)
+      return ZERO;
+    else
+      emit_load_imm(scratch, c->imm, s);
+    return scratch;
+  }
+  default:
+    emit_load(scratch, home_offset(v), FP, s);
+    return scratch;
+  }
+}
+
+// The register to compute v into: its own, or scratch.
+char *MipsLowering::target(int v, char *scratch)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_CALLER)
+    return caller_regs[h.index];
+  if (h.kind == HOME_CALLEE)
+    return callee_regs[h.index];
+  return scratch;
+}
+
+// v has been computed into reg; put it in its home.
+void MipsLowering::define(int v, char *reg, ostream &s)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_SLOT || h.kind == HOME_ARG)
+    emit_store(reg, home_offset(v), FP, s);
+  else if (h.kind == HOME_CALLER || h.kind == HOME_CALLEE) {
+    char *home = target(v, reg);
+    if (home != reg)
+      emit_move(home, reg, s);
+  }
+}
+
+void MipsLowering::label_ref(int b, ostream &s)
+{
+  emit_label_ref(labels[b], s);
+  referenced[b] = true;
+}
+
+void MipsLowering::code_prologue(ostream &s)
+{
+  int frame = frame_size();
+
+  emit_addiu(SP, SP, -frame * WORD_SIZE, s);
+  emit_store(FP, frame, SP, s);
+  emit_store(SELF, frame - 1, SP, s);
+  emit_store(RA, frame - 2, SP, s);
+  for (int i = 0; i < alloc.callee_used; i++)
+    emit_store(callee_regs[i], frame - 3 - i, SP, s);
+  emit_addiu(FP, SP, frame * WORD_SIZE, s);
+  emit_move(SELF, ACC, s);
+}
+
+void MipsLowering::code_epilogue(ostream &s)
+{
+  int frame = frame_size();
+
+  for (int i = 0; i < alloc.callee_used; i++)
+    emit_load(callee_regs[i], frame - 3 - i, SP, s);
+  emit_load(FP, frame, SP, s);
+  emit_load(SELF, frame - 1, SP, s);
+  emit_load(RA, frame - 2, SP, s);
+  emit_addiu(SP, SP, (frame + fn.nargs) * WORD_SIZE, s);
+  emit_return(s);
+}
+
+// Abort with the file name and line if the object in reg is void.
+void MipsLowering::code_void_check(char *reg, int line, ostream &s)
+{
+  int ok = label_index++;
+  emit_bne(reg, ZERO, ok, s);
+  emit_load_string(ACC, filename, s);
+  emit_load_imm(T1, line, s);
+  emit_jal("_dispatch_abort", s);
+  emit_label_def(ok, s);
+}
+
+//
+// The arguments are stored below SP in one go, the first one deepest,
+// and the receiver goes in ACC.  Self is never void.
+//
+void MipsLowering::code_call(const IRInsn &in, ostream &s)
+{
+  int n = in.args.size();
+  bool in_place = args_in_place(in);
+  if (in_place) {
+    for (int k = 0; k < n; k++)
+      emit_store(use(in.args[k], T1, s), fn.nargs - k, FP, s);
+  } else if (n > 0) {
+    emit_addiu(SP, SP, -n * WORD_SIZE, s);
+    for (int k = 0; k < n; k++)
+      emit_store(use(in.args[k], T1, s), n - k, SP, s);
+  }
+  char *receiver = use(in.a, ACC, s);
+  if (in.a != 0)
+    code_void_check(receiver, in.line, s);
+  if (receiver != (char *)ACC)
+    emit_move(ACC, receiver, s);
+  if (in.tail) {
+    code_tail_call(in, in_place, s);
+    return;
+  }
+  if (in.op == IR_STATIC_DISPATCH) {
+    emit_jal((char *)in.label.c_str(), s);
+  } else {
+    emit_load(T1, DISPTABLE_OFFSET, ACC, s);
+    emit_load(T1, in.imm, T1, s);
+    emit_jalr(T1, s);
+  }
+  define(in.d, ACC, s);
+}
+
+//
+// A tail call with no more arguments than the caller's can store them
+// straight over the caller's, unless it is passing on one of those.
+//
+bool MipsLowering::args_in_place(const IRInsn &in)
+{
+  if (!in.tail || int(in.args.size()) > fn.nargs || alloc.homes[in.a].kind == HOME_ARG)
+    return false;
+  for (int arg : in.args)
+    if (alloc.homes[arg].kind == HOME_ARG)
+      return false;
+  return true;
+}
+
+//
+// A tail call leaves in place of the caller, once the arguments are
+// stored and the receiver is in ACC.  The saved registers are restored
+// and the arguments moved up to end where the caller's began, and the
+// callee is jumped to with the caller's RA, so that it returns to the
+// caller's caller and pops its arguments for it.  The saved registers
+// come out of the frame first, since with more arguments than the
+// caller had the new ones run down over them.
+//
+void MipsLowering::code_tail_call(const IRInsn &in, bool in_place, ostream &s)
+{
+  int n = in.args.size();
+  if (in.op == IR_DISPATCH) {
+    emit_load(T1, DISPTABLE_OFFSET, ACC, s);
+    emit_load(T1, in.imm, T1, s);
+  }
+  for (int i = 0; i < alloc.callee_used; i++)
+    emit_load(callee_regs[i], -3 - i, FP, s);
+  emit_load(SELF, -1, FP, s);
+  emit_load(RA, -2, FP, s);
+  emit_load(A1, 0, FP, s);
+  for (int k = 0; k < n && !in_place; k++) {
+    emit_load(T2, n - k, SP, s);
+    emit_store(T2, fn.nargs - k, FP, s);
+  }
+  emit_addiu(SP, FP, (fn.nargs - n) * WORD_SIZE, s);
+  emit_move(FP, A1, s);
+  if (in.op == IR_STATIC_DISPATCH)
+    emit_jump((char *)in.label.c_str(), s);
+  else
+    emit_jr(T1, s);
+}
+
+//
+// An object of imm words is allocated inline, as _MemMgr_Alloc would:
+// the heap pointer is bumped past it and the eyecatcher word before
+// it, and the prototype is copied in with unrolled loads and stores.
+// Only an allocation that would reach the heap's limit goes to
+// Object.copy, which has the collector make room.  So does every
+// allocation of a large object, and every one in GC test mode, where
+// Object.copy collects first.  The init routine is called after, unless
+// it is trivial (IR_NEW_PROTO).
+//
+void MipsLowering::code_new(const IRInsn &in, ostream &s)
+{
+  std::string proto = in.label + PROTOBJ_SUFFIX;
+  int slow = -1, done = -1;
+  if (in.imm <= MAX_INLINE_NEW && cgen_Memmgr_Test != GC_TEST) {
+    slow = label_index++;
+    done = label_index++;
+    emit_addiu(T1, HEAP_PTR, (in.imm + 1) * WORD_SIZE, s);
+    emit_bge(T1, HEAP_LIMIT, slow, s);
+    emit_load_address(T2, (char *)proto.c_str(), s);
+    for (int k = -1; k < in.imm; k++) {
+      emit_load(ACC, k, T2, s);
+      emit_store(ACC, k + 1, HEAP_PTR, s);
+    }
+    emit_addiu(ACC, HEAP_PTR, WORD_SIZE, s);
+    emit_move(HEAP_PTR, T1, s);
+    emit_branch(done, s);
+    emit_label_def(slow, s);
+  }
+  emit_load_address(ACC, (char *)proto.c_str(), s);
+  emit_jal("Object.copy", s);
+  if (done >= 0)
+    emit_label_def(done, s);
+  if (in.op == IR_NEW)
+    s << JAL << in.label << CLASSINIT_SUFFIX << endl;
+}
+
+//
+// Branch to block b if the condition holds, or if it doesn't when
+// negate is set.  The condition is either the word cond or, folded
+// into the branch, the comparison cmp.
+//
+void MipsLowering::code_cond(const IRInsn *cmp, int cond, bool negate, int b, ostream &s)
+{
+  if (cmp == NULL || cmp->op == IR_ISVOID || cmp->op == IR_NOT) {
+    // isvoid and not hold when their operand is 0
+    bool if_zero = (cmp != NULL) != negate;
+    char *x = use(cmp ? cmp->a : cond, T1, s);
+    s << (if_zero ? BEQZ : BNEZ) << x << " ";
+  } else {
+    const char *op;
+    if (cmp->op == IR_LT)
+      op = negate ? BGE : BLT;
+    else if (cmp->op == IR_LE)
+      op = negate ? BGT : BLEQ;
+    else
+      op = negate ? BNE : BEQ;
+    char *x = use(cmp->a, T1, s);
+    int imm;
+    if (const_imm(cmp->b, imm)) {
+      s << op << x << " " << imm << " ";
+    } else {
+      char *y = use(cmp->b, T2, s);
+      s << op << x << " " << y << " ";
+    }
+  }
+  label_ref(b, s);
+  s << endl;
+}
+
+void MipsLowering::code_branch(const IRInsn *cmp, const IRInsn &br, ostream &s)
+{
+  if (br.target == block + 1) {
+    code_cond(cmp, br.a, true, br.other, s);
+    return;
+  }
+  code_cond(cmp, br.a, false, br.target, s);
+  if (br.other != block + 1) {
+    s << BRANCH;
+    label_ref(br.other, s);
+    s << endl;
+  }
+}
+
+// The table holds the address of each block; it goes in the data segment.
+void MipsLowering::code_switch(const IRInsn &in, ostream &s)
+{
+  int n = in.table.size(), table = label_index++;
+  char *x = use(in.a, T1, s);
+  emit_blti(x, in.imm, labels[in.other], s);
+  emit_bgti(x, in.imm + n - 1, labels[in.other], s);
+  referenced[in.other] = true;
+  emit_addiu(T1, x, -in.imm, s);
+  emit_sll(T1, T1, 2, s);
+  s << LA << T2 << " ";
+  emit_label_ref(table, s);
+  s << endl;
+  emit_addu(T1, T1, T2, s);
+  emit_load(T1, 0, T1, s);
+  s << "\tjr\t" << T1 << endl;
+
+  tables << "\t.data" << endl << ALIGN;
+  emit_label_def(table, tables);
+  for (int b : in.table) {
+    tables << WORD;
+    label_ref(b, tables);
+    tables << endl;
+  }
+  tables << "\t.text" << endl;
+}
+
+void MipsLowering::code_insn(const IRInsn &in, ostream &s)
+{
+  char *x, *y, *d;
+  int imm;
+
+  switch (in.op) {
+  case IR_LI:
+  case IR_LA:
+    if (alloc.homes[in.d].kind == HOME_CONST)
+      break;
+    d = target(in.d, ACC);
+    if (in.op == IR_LI)
+      emit_load_imm(d, in.imm, s);
+    else
+      emit_load_address(d, (char *)in.label.c_str(), s);
+    define(in.d, d, s);
+    break;
+  case IR_MOVE:
+    d = target(in.d, ACC);
+    x = use(in.a, d, s);
+    if (x != d)
+      emit_move(d, x, s);
+    define(in.d, d, s);
+    break;
+  case IR_ARG:
+    if (alloc.homes[in.d].kind == HOME_ARG && alloc.homes[in.d].index == in.imm)
+      break;
+    d = target(in.d, ACC);
+    emit_load(d, fn.nargs - in.imm, FP, s);
+    define(in.d, d, s);
+    break;
+  case IR_ADD:
+  case IR_SUB:
+    // addi traps on overflow like add and sub do
+    x = use(in.a, T1, s);
+    d = target(in.d, ACC);
+    if (const_imm(in.b, imm) && imm > -32768 && imm < 32768) {
+      s << ADDI << d << " " << x << " " << (in.op == IR_ADD ? imm : -imm) << endl;
+    } else {
+      y = use(in.b, T2, s);
+      if (in.op == IR_ADD)
+        emit_add(d, x, y, s);
+      else
+        emit_sub(d, x, y, s);
+    }
+    define(in.d, d, s);
+    break;
+  case IR_MUL:
+  case IR_DIV:
+  case IR_LT:
+  case IR_LE:
+  case IR_EQ:
+    x = use(in.a, T1, s);
+    y = use(in.b, T2, s);
+    d = target(in.d, ACC);
+    switch (in.op) {
+    case IR_MUL: emit_mul(d, x, y, s); break;
+    case IR_DIV: emit_div(d, x, y, s); break;
+    case IR_LT: emit_slt(d, x, y, s); break;
+    case IR_LE: emit_sle(d, x, y, s); break;
+    default: emit_seq(d, x, y, s); break;
+    }
+    define(in.d, d, s);
+    break;
+  case IR_NEG:
+  case IR_NOT:
+  case IR_ISVOID:
+    x = use(in.a, T1, s);
+    d = target(in.d, ACC);
+    if (in.op == IR_NEG)
+      emit_neg(d, x, s);
+    else if (in.op == IR_NOT)
+      emit_xori(d, x, 1, s);
+    else
+      emit_seq(d, x, ZERO, s);
+    define(in.d, d, s);
+    break;
+  case IR_LOAD:
+  case IR_UNBOX:
+    x = use(in.a, T1, s);
+    d = target(in.d, ACC);
+    emit_load(d, in.op == IR_LOAD ? in.imm : DEFAULT_OBJFIELDS, x, s);
+    define(in.d, d, s);
+    break;
+  case IR_STORE:
+    x = use(in.a, T1, s);
+    y = use(in.b, T2, s);
+    emit_store(y, in.imm, x, s);
+    break;
+  case IR_BOX_INT:
+    // the collector doesn't look at BOXWORD, so the word waits there
+    if (cgen_Memmgr != GC_NOGC && !const_imm(in.a, imm)) {
+      x = use(in.a, T1, s);
+      emit_load_address(T2, BOXWORD, s);
+      emit_store(x, 0, T2, s);
+    }
+    emit_partial_load_address(ACC, s);
+    emit_protobj_ref(Int, s);
+    s << endl;
+    emit_jal("Object.copy", s);
+    if (cgen_Memmgr != GC_NOGC && !const_imm(in.a, imm)) {
+      emit_load_address(T1, BOXWORD, s);
+      emit_load(T1, 0, T1, s);
+      x = T1;
+    } else {
+      x = use(in.a, T1, s);
+    }
+    emit_store_int(x, ACC, s);
+    define(in.d, ACC, s);
+    break;
+  case IR_BOX_BOOL:
+    d = target(in.d, ACC);
+    if (const_imm(in.a, imm)) {
+      emit_load_bool(d, BoolConst(imm), s);
+    } else {
+      x = use(in.a, T1, s);
+      if (d == x)
+        d = ACC;
+      emit_load_bool(d, truebool, s);
+      emit_bne(x, ZERO, label_index, s);
+      emit_load_bool(d, falsebool, s);
+      emit_label_def(label_index, s);
+      label_index++;
+    }
+    define(in.d, d, s);
+    break;
+  case IR_NEW:
+  case IR_NEW_PROTO:
+    code_new(in, s);
+    define(in.d, ACC, s);
+    break;
+  case IR_NEW_SELF:
+    // class_objTab holds the prototype and init routine of each tag
+    emit_load_address(T1, CLASSOBJTAB, s);
+    emit_load(T2, TAG_OFFSET, SELF, s);
+    emit_sll(T2, T2, 3, s);
+    emit_addu(T1, T1, T2, s);
+    emit_push(T1, s);
+    emit_load(ACC, 0, T1, s);
+    emit_jal("Object.copy", s);
+    emit_load(T1, 1, SP, s);
+    emit_addiu(SP, SP, 4, s);
+    emit_load(T1, 1, T1, s);
+    emit_jalr(T1, s);
+    define(in.d, ACC, s);
+    break;
+  case IR_DISPATCH:
+  case IR_STATIC_DISPATCH:
+    code_call(in, s);
+    break;
+  case IR_OBJ_EQ:
+    // equality_test answers ACC if T1 and T2 are equal, A1 if not
+    x = use(in.a, T1, s);
+    if (x != (char *)T1)
+      emit_move(T1, x, s);
+    y = use(in.b, T2, s);
+    if (y != (char *)T2)
+      emit_move(T2, y, s);
+    emit_load_imm(ACC, 1, s);
+    emit_beq(T1, T2, label_index, s);
+    emit_load_imm(A1, 0, s);
+    emit_jal("equality_test", s);
+    emit_label_def(label_index, s);
+    label_index++;
+    define(in.d, ACC, s);
+    break;
+  case IR_INIT:
+    emit_move(ACC, SELF, s);
+    s << JAL << in.label << CLASSINIT_SUFFIX << endl;
+    break;
+  case IR_PRINT_INT:
+    x = use(in.b, T2, s);
+    if (in.b != 0)
+      code_void_check(x, in.line, s);
+    x = use(in.a, ACC, s);
+    if (x != (char *)ACC)
+      emit_move(ACC, x, s);
+    emit_load_imm("$v0", 1, s);
+    s << "\tsyscall" << endl;
+    break;
+  case IR_CHECK_VOID:
+    code_void_check(use(in.a, T2, s), in.line, s);
+    break;
+  case IR_JUMP:
+    if (in.target != block + 1) {
+      s << BRANCH;
+      label_ref(in.target, s);
+      s << endl;
+    }
+    break;
+  case IR_BRANCH:
+    code_branch(NULL, in, s);
+    break;
+  case IR_SWITCH:
+    code_switch(in, s);
+    break;
+  case IR_RETURN:
+    x = use(in.a, ACC, s);
+    if (x != (char *)ACC)
+      emit_move(ACC, x, s);
+    code_epilogue(s);
+    break;
+  case IR_ABORT_CASE_VOID:
+    emit_load_string(ACC, filename, s);
+    emit_load_imm(T1, in.line, s);
+    emit_jal("_case_abort2", s);
+    break;
+  case IR_ABORT_CASE:
+    x = use(in.a, ACC, s);
+    if (x != (char *)ACC)
+      emit_move(ACC, x, s);
+    emit_jal("_case_abort", s);
+    break;
+  }
+}
+
+void MipsLowering::code(ostream &s)
+{
+  std::ostringstream out;
+  if (cgen_debug)
+    fn.print(out, "# ");
+  code_prologue(out);
+
+  std::vector<std::string> text(fn.blocks.size());
+  for (block = 0; block < int(fn.blocks.size()); block++) {
+    std::ostringstream bs;
+    const std::vector<IRInsn> &insns = fn.blocks[block].insns;
+    for (size_t i = 0; i < insns.size(); i++) {
+      const IRInsn &in = insns[i];
+      if (i + 2 == insns.size() && insns[i + 1].op == IR_BRANCH &&
+          insns[i + 1].a == in.d && alloc.use_count[in.d] == 1 &&
+          (in.op == IR_LT || in.op == IR_LE || in.op == IR_EQ ||
+           in.op == IR_ISVOID || in.op == IR_NOT)) {
+        code_branch(&in, insns[i + 1], bs);
+        break;
+      }
+      code_insn(in, bs);
+      // a tail call has returned for the function
+      if (in.tail)
+        break;
+    }
+    text[block] = bs.str();
+  }
+
+  for (size_t b = 0; b < text.size(); b++) {
+    if (referenced[b])
+      emit_label_def(labels[b], out);
+    out << text[b];
+  }
+  emit_body(out.str(), s);
+  s << tables.str();
+}
+
+// Lower a function for the selected back end.
+static void code_function(IRFunction &fn, CgenNodeP curr, ostream &s)
+{
+  if (cgen_target == TARGET_X86_64)
+    code_x86_64_function(fn, curr, s);
+  else if (cgen_target == TARGET_C)
+    code_c_function(fn, curr, s);
+  else
+    MipsLowering(fn, curr).code(s);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Unboxed values
+//
+// code_unboxed computes the value of an Int or Bool expression as a raw
+// word, 0 or 1 for a Bool, instead of a pointer to an object.
+// Arithmetic, comparisons, predicates and out_int take their operands
+// this way, so intermediate results never reach the heap.  A value is
+// boxed only where it escapes: attribute stores, dispatch arguments,
+// method results and the like.  A let variable of type Int or Bool that
+// is never read as an object (see boxes_var) is kept raw.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static bool is_unboxed_type(Symbol type)
+{
+  return type == Int || type == Bool;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // coding strings, ints, and booleans
@@ -575,6 +1357,7 @@ void CgenClassTable::code_global_data()
   // The following global names must be defined first.
   //
   str << GLOBAL << CLASSNAMETAB << endl;
+  str << GLOBAL << CLASSRANGETAB << endl;
   str << GLOBAL;
   emit_protobj_ref(main, str);
   str << endl;
@@ -604,6 +1387,11 @@ void CgenClassTable::code_global_data()
       << WORD << boolclasstag << endl;
   str << STRINGTAG << LABEL
       << WORD << stringclasstag << endl;
+
+  // where an Int waits to be boxed while Object.copy may collect
+  if (cgen_Memmgr != GC_NOGC)
+    str << BOXWORD << LABEL
+        << WORD << 0 << endl;
 }
 
 //***************************************************
@@ -698,9 +1486,7 @@ void CgenClassTable::code_constants()
 void CgenClassTable::code_class_nameTab()
 {
   str << CLASSNAMETAB << LABEL;
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_)
+  for (CgenNodeP curr : classes_ordered)
   {
     Symbol curr_name = curr->get_name();
     char *curr_name_str = curr_name->get_string();
@@ -714,9 +1500,7 @@ void CgenClassTable::code_class_nameTab()
 void CgenClassTable::code_class_objTab()
 {
   str << CLASSOBJTAB << LABEL;
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_)
+  for (CgenNodeP curr : classes_ordered)
   {
     Symbol curr_name = curr->get_name();
     char *curr_name_str = curr_name->get_string();
@@ -728,15 +1512,18 @@ void CgenClassTable::code_class_objTab()
   }
 }
 
+// The last tag of each class's subtree, by tag.
+void CgenClassTable::code_class_rangeTab()
+{
+  str << CLASSRANGETAB << LABEL;
+  for (CgenNodeP curr : classes_ordered)
+    str << WORD << curr->max_tag << endl;
+}
+
 void CgenClassTable::code_dispTab()
 {
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_)
+  for (CgenNodeP curr : classes_ordered)
   {
-    curr->fill_dispatch_table();
-    sym_node[curr->name] = curr;
-
     emit_disptable_ref(curr->name, str);
     str << LABEL;
 
@@ -748,48 +1535,28 @@ void CgenClassTable::code_dispTab()
   }
 }
 
+//
+// A class starts from its parent's table, so a method keeps its slot
+// in every subclass; an override only replaces the defining class.
+//
 void CgenNode::fill_dispatch_table()
 {
-  std::vector<CgenNodeP> ancestory_curr_class;
-  ancestory_curr_class.push_back(this);
-  CgenNodeP par = get_parentnd();
-  while (par != NULL)
-  {
-    ancestory_curr_class.push_back(par);
-    par = par->get_parentnd();
-  }
-  std::reverse(ancestory_curr_class.begin(), ancestory_curr_class.end());
+  dispatch_table = parentnd->dispatch_table;
+  dispatch_slots = parentnd->dispatch_slots;
 
-  for (CgenNodeP curr : ancestory_curr_class)
+  for (int i = features->first(); features->more(i); i = features->next(i))
   {
-    Features curfs = curr->features;
-    for (int i = curfs->first(); curfs->more(i); i = curfs->next(i))
+    Feature feature = features->nth(i);
+    if (!feature->is_method())
+      continue;
+    Symbol method = ((method_class *)feature)->name;
+    auto slot = dispatch_slots.find(method);
+    if (slot != dispatch_slots.end())
+      dispatch_table[slot->second].second = name;
+    else
     {
-      Feature feature = curfs->nth(i);
-      if (feature->is_method())
-      {
-        method_class *method = (method_class *)feature;
-
-        bool found = false;
-        for (auto &pair : dispatch_table)
-        {
-          if (pair.first == method->name)
-          {
-            pair.second = curr->name;
-            found = true;
-            break;
-          }
-        }
-        if (found)
-        {
-          continue;
-        }
-        else
-        {
-          auto item = std::make_pair(method->name, curr->name);
-          dispatch_table.push_back(item);
-        }
-      }
+      dispatch_slots[method] = dispatch_table.size();
+      dispatch_table.push_back(std::make_pair(method, name));
     }
   }
 }
@@ -798,13 +1565,10 @@ void CgenNode::fill_dispatch_table()
 
 void CgenClassTable::code_protObj()
 {
-  std::vector<CgenNodeP> classes_ = get_classes();
-
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_)
+  for (CgenNodeP curr : classes_ordered)
   { 
     
-    int tag = get_class_tag(curr->name);
+    int tag = curr->tag;
     curr->fill_attr_layout();
     int obj_size = DEFAULT_OBJFIELDS + curr->attr_layout.size();
     str << WORD << "-1" << endl;
@@ -879,10 +1643,8 @@ void CgenNode::fill_attr_layout()
   int index = 0;
   
   for (attr_class* curr : attr_layout){
-    std::pair<int, int>* value = new std::pair<int, int>();
+    std::pair<int, int>* value = arena.make<std::pair<int, int>>(0, index);
     Symbol key = curr -> name;
-    value->first = 0;
-    value->second = index;
     variables.addid(key, value);
     index++;
   }
@@ -890,64 +1652,179 @@ void CgenNode::fill_attr_layout()
 
 int CgenClassTable::get_class_tag(Symbol given_name)
 {
-  int index = -1;
-  for (int i = 0; i < int(classes_ordered.size()); ++i)
-  {
-    if (classes_ordered[i]->name == given_name)
-    {
-      index = i;
-      break;
-    }
+  CgenNodeP node = find_class(given_name);
+  return node ? node->tag : -1;
+}
+
+CgenNodeP CgenClassTable::find_class(Symbol class_name)
+{
+  std::unordered_map<Symbol, CgenNodeP>::iterator it = sym_node.find(class_name);
+  return it == sym_node.end() ? NULL : it->second;
+}
+
+static void index_subtree(CgenNodeP node, int depth, std::vector<CgenNodeP> &order)
+{
+  node->depth = depth;
+  node->tag = order.size();
+  order.push_back(node);
+  node->fill_dispatch_table();
+
+  // the children list is newest first
+  std::vector<CgenNodeP> children;
+  for (List<CgenNode> *l = node->get_children(); l; l = l->tl())
+    children.push_back(l->hd());
+  node->overridden.assign(node->dispatch_table.size(), false);
+  for (auto c = children.rbegin(); c != children.rend(); ++c) {
+    CgenNodeP child = *c;
+    index_subtree(child, depth + 1, order);
+    for (size_t s = 0; s < node->dispatch_table.size(); s++)
+      if (child->overridden[s] ||
+          child->dispatch_table[s].second != node->dispatch_table[s].second)
+        node->overridden[s] = true;
   }
-  return index;
+  node->max_tag = order.size() - 1;
 }
 
-void CgenClassTable::fill_class_tag()
+//
+// Classes are tagged in preorder over the inheritance tree, children
+// in the order they were installed, so the tags of a class and its
+// descendants are the range tag..max_tag and a subtype test is two
+// comparisons.  Each class also records its depth, its dispatch
+// table, filled top-down from its parent's, and which of its methods
+// its descendants redefine, gathered bottom-up, so that no
+// code generation path has to search the class list or walk the
+// inheritance tree again.
+//
+void CgenClassTable::index_classes()
 { 
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  classes_ordered = classes_;
+  classes_ordered.clear();
+  index_subtree(root(), 0, classes_ordered);
 }
 
-void CgenClassTable::code_init(){
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_){
-    emit_init_ref(curr->name, str);
-    str << LABEL;
-    emit_addiu(SP, SP, -12, str);
-    emit_store(FP, 3, SP, str);
-    emit_store(SELF, 2, SP, str);
-    emit_store(RA, 1, SP, str);
-    emit_addiu(FP, SP, 16, str);
-    emit_move(SELF, ACC, str);
+//
+// An attribute needs initializing unless it has no initializer or one
+// that is the constant its prototype already holds.
+//
+static bool needs_init(attr_class *attr)
+{
+  int i;
+  bool v;
+  if (attr->init->is_no_expr())
+    return false;
+  if (attr->type_decl == Int && attr->init->int_value(i) && i == 0)
+    return false;
+  if (attr->type_decl == Bool && attr->init->bool_value(v) && !v)
+    return false;
+  return true;
+}
 
+//
+// A class's init routine is trivial when neither the class nor any of
+// its ancestors has an attribute that needs initializing: new then
+// only copies the prototype.  Run after the optimization passes, since
+// folding may leave an initializer that is the default.
+//
+void CgenClassTable::find_trivial_inits()
+{
+  for (CgenNodeP curr : classes_ordered) {
     CgenNodeP parent = curr->get_parentnd();
+    curr->trivial_init = parent->name == No_class || parent->trivial_init;
+    Features curfs = curr->features;
+    for (int i = curfs->first(); curfs->more(i); i = curfs->next(i))
+      if (!curfs->nth(i)->is_method() && needs_init((attr_class *)curfs->nth(i)))
+        curr->trivial_init = false;
+  }
+}
 
-    if(parent -> name != No_class){
-      str << JAL;
-      emit_init_ref(parent->name, str);
-      str << endl;
-    }
+//
+// The init routines and new count the calls to init routines they
+// would have made in a chain of one per class, and how many of those
+// they leave out.
+//
+static std::atomic<int> init_calls, init_calls_removed;
 
-    if(curr -> basic() == 0){
-      for (int i = 0; i < int(curr->attr_layout.size()); ++i){
+static void print_init_stats(ostream &s)
+{
+  s << "init: " << init_calls_removed << " of " << init_calls
+    << " init calls removed" << endl;
+}
 
-        attr_class* curr_attr = curr->attr_layout[i];
-        Expression curr_init = curr_attr -> init;
-        if(curr_init -> is_no_expr() == false){
-          curr_init -> code(str, curr, this);
-          emit_store(ACC, i+3, SELF, str);
-        }
-      }
+//
+// A class's init routine initializes the attributes of its ancestors
+// itself, rather than calling its parent's.  It stops at an ancestor
+// from another file, so that a run-time error reports the right file,
+// and calls that ancestor's routine unless it is trivial.
+//
+void CgenClassTable::code_init(CgenNodeP curr, ostream &s)
+{
+  // C functions carry their own names
+  if (cgen_target != TARGET_C) {
+    emit_init_ref(curr->name, s);
+    s << LABEL;
+  }
+
+  std::string name = std::string(curr->name->get_string()) + CLASSINIT_SUFFIX;
+  IRFunction fn(name, 0, curr->get_line_number());
+  IRBuilder b(fn, curr, this);
+
+  CgenNodeP from = curr->get_parentnd();
+  while (from->name != No_class && !from->basic() &&
+         from->get_filename() == curr->get_filename())
+    from = from->get_parentnd();
+
+  if (curr->get_parentnd()->name != No_class) {
+    init_calls++;
+    if (from->name != No_class && !from->trivial_init) {
+      IRInsn init(IR_INIT);
+      init.a = 0;
+      init.label = from->name->get_string();
+      b.emit(init);
+    } else
+      init_calls_removed++;
+  }
+
+  // the attributes of the classes from there on down
+  int first = from->name != No_class ? from->attr_layout.size() : 0;
+  for (int i = first; i < int(curr->attr_layout.size()); ++i) {
+    attr_class *attr = curr->attr_layout[i];
+    if (needs_init(attr)) {
+      IRInsn store(IR_STORE);
+      store.b = attr->init->code(b);
+      store.a = 0;
+      store.imm = i + DEFAULT_OBJFIELDS;
+      b.emit(store);
     }
-    emit_move(ACC, SELF, str);
-    emit_load(FP, 3, SP, str);
-    emit_load(SELF, 2, SP, str);
-    emit_load(RA, 1, SP, str);
-    emit_addiu(SP, SP, 12, str);
-    str << RET << endl;
   }
+  IRInsn ret(IR_RETURN);
+  ret.a = 0;
+  b.emit(ret);
+  b.finish();
+  code_function(fn, curr, s);
+}
+
+//
+// A dispatch is bound at compile time, and becomes a static dispatch,
+// when no descendant of the class of the receiver's static type
+// redefines the method (class hierarchy analysis).  These count the
+// dispatches coded on all threads and how many were bound, inlined or,
+// with -O, made tail calls (see mark_tail_calls).
+//
+static std::atomic<int> dispatches, devirtualized, inlined, tail_calls;
+
+static void print_dispatch_stats(ostream &s)
+{
+  s << "dispatch: " << devirtualized << " of " << dispatches
+    << " calls bound statically, " << inlined << " calls inlined, "
+    << tail_calls << " tail calls" << endl;
+}
+
+// What optimize_loops (ir.cc) did, with -O.
+static std::atomic<int> loop_hoisted, loop_promoted;
+
+static void print_loop_stats(ostream &s)
+{
+  s << "loops: " << loop_hoisted << " instructions hoisted, " << loop_promoted
+    << " attributes kept in registers" << endl;
 }
 
 CgenClassTable::CgenClassTable(Classes classes, ostream &s) : nds(NULL), str(s)
@@ -964,40 +1841,130 @@ CgenClassTable::CgenClassTable(Classes classes, ostream &s) : nds(NULL), str(s)
   install_classes(classes);
   build_inheritance_tree();
   
-  fill_class_tag();
+  index_classes();
   stringclasstag = get_class_tag(Str);
   intclasstag = get_class_tag(Int);
   boolclasstag = get_class_tag(Bool);
 
+  if (cgen_optimize) {
+    if (cgen_debug)
+      cout << "folding constants" << endl;
+    fold_constants();
+    find_inlinable();
+  }
+  find_trivial_inits();
+
   code();
   traverse_tree();
+  if (cgen_debug)
+    print_dispatch_stats(cout);
+  if (cgen_debug)
+    print_init_stats(cout);
+  if (cgen_debug && cgen_optimize)
+    print_loop_stats(cout);
+  if (cgen_debug && cgen_optimize)
+    print_peephole_stats(cout);
+  if (cgen_debug)
+    print_memory_stats(cout);
   exitscope();
 }
 
+//
+// The init routines and methods are coded by a pool of workers,
+// COOL_JOBS of them or by default one per processor.  A worker takes a
+// class at a time and codes its init routine and methods into a buffer
+// of the class's own, or takes them from the code cache (codecache.h)
+// when COOL_CACHE names one; the buffers are written out in class
+// order, so the output does not depend on the number of workers, and
+// as soon as all the classes before them are done, so they are not all
+// held at once.  Only the worker holds the class's variables;
+// everything else it uses is only read.
+//
 void CgenClassTable::traverse_tree()
 {
   std::vector<CgenNodeP> classes_ = get_classes();
-  for (CgenNodeP curr : classes_)
-  {
-    Features curfs = curr->features;
-    if (!curr->basic())
+  std::vector<std::string> text(classes_.size());
+  std::vector<bool> done(classes_.size());
+  size_t written = 0;
+  std::mutex out_lock;
+  std::atomic<size_t> next(0);
+  const char *cache_dir = getenv("COOL_CACHE");
+  std::unique_ptr<CodeCache> cache(cache_dir ? new CodeCache(cache_dir, classes_) : NULL);
+
+  auto finish = [&](size_t c) {
+    std::lock_guard<std::mutex> lock(out_lock);
+    done[c] = true;
+    for (; written < classes_.size() && done[written]; written++) {
+      str << text[written];
+      std::string().swap(text[written]);
+    }
+  };
+
+  auto worker = [&]() {
+    for (size_t c = next++; c < classes_.size(); c = next++)
     {
-      for (int i = curfs->first(); curfs->more(i); i = curfs->next(i))
-      {
-        Feature feature = curfs->nth(i);
-        if (feature->is_method())
+      CgenNodeP curr = classes_[c];
+      std::string key;
+      if (cache) {
+        key = cache->key(curr);
+        if (cache->lookup(key, text[c])) {
+          finish(c);
+          continue;
+        }
+      }
+      label_space = curr->tag;
+      label_index = 0;
+
+      std::ostringstream s;
+      code_init(curr, s);
+      // the basic classes' methods are in the runtime
+      Features curfs = curr->features;
+      for (int i = curfs->first(); curfs->more(i); i = curfs->next(i))
+      {
+        Feature feature = curfs->nth(i);
+        if (feature->is_method() && !curr->basic())
         {
           method_class *method = (method_class *)feature;
-          str << curr->name << "." << method->name << LABEL;
-          method->code(str, curr, this);
+          if (cgen_target != TARGET_C)
+            s << curr->name << "." << method->name << LABEL;
+          method->code(s, curr, this);
         }
       }
+      text[c] = s.str();
+      if (cache)
+        cache->store(key, text[c]);
+      finish(c);
     }
-  }
+    label_space = -1;
+  };
+
+  const char *env = getenv("COOL_JOBS");
+  int jobs = env ? atoi(env) : std::thread::hardware_concurrency();
+  jobs = std::max(1, std::min(jobs, int(classes_.size())));
+
+  std::vector<std::thread> pool;
+  for (int i = 1; i < jobs; i++)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &t : pool)
+    t.join();
+  if (cgen_debug && cache)
+    cache->print_stats(cout);
 }
 
-void CgenClassTable::install_basic_classes()
+//
+// The basic classes are built once per process, the first time a
+// class table needs them.  cgen builds them before it reads the
+// program (see astbin.cc), so that their names come first in the
+// string tables.
+//
+static std::vector<CgenNodeP> special_classes, basic_classes;
+
+void prepare_basic_classes()
 {
+  if (!basic_classes.empty())
+    return;
+  initialize_constants();
 
   // The tree package uses these globals to annotate the classes built below.
   // curr_lineno  = 0;
@@ -1011,15 +1978,15 @@ void CgenClassTable::install_basic_classes()
   // SELF_TYPE is the self class; it cannot be redefined or inherited.
   // prim_slot is a class known to the code generator.
   //
-  addid(No_class,
+  special_classes.push_back(
         new CgenNode(class_(No_class, No_class, nil_Features(), filename),
-                     Basic, this));
-  addid(SELF_TYPE,
+                     Basic, NULL));
+  special_classes.push_back(
         new CgenNode(class_(SELF_TYPE, No_class, nil_Features(), filename),
-                     Basic, this));
-  addid(prim_slot,
+                     Basic, NULL));
+  special_classes.push_back(
         new CgenNode(class_(prim_slot, No_class, nil_Features(), filename),
-                     Basic, this));
+                     Basic, NULL));
 
   //
   // The Object class has no parent class. Its methods are
@@ -1030,7 +1997,7 @@ void CgenClassTable::install_basic_classes()
   // There is no need for method bodies in the basic classes---these
   // are already built in to the runtime system.
   //
-  install_class(
+  basic_classes.push_back(
       new CgenNode(
           class_(Object,
                  No_class,
@@ -1040,7 +2007,7 @@ void CgenClassTable::install_basic_classes()
                          single_Features(method(type_name, nil_Formals(), Str, no_expr()))),
                      single_Features(method(copy, nil_Formals(), SELF_TYPE, no_expr()))),
                  filename),
-          Basic, this));
+          Basic, NULL));
 
   //
   // The IO class inherits from Object. Its methods are
@@ -1049,7 +2016,7 @@ void CgenClassTable::install_basic_classes()
   //        in_string() : Str                    reads a string from the input
   //        in_int() : Int                         "   an int     "  "     "
   //
-  install_class(
+  basic_classes.push_back(
       new CgenNode(
           class_(IO,
                  Object,
@@ -1063,27 +2030,27 @@ void CgenClassTable::install_basic_classes()
                          single_Features(method(in_string, nil_Formals(), Str, no_expr()))),
                      single_Features(method(in_int, nil_Formals(), Int, no_expr()))),
                  filename),
-          Basic, this));
+          Basic, NULL));
 
   //
   // The Int class has no methods and only a single attribute, the
   // "val" for the integer.
   //
-  install_class(
+  basic_classes.push_back(
       new CgenNode(
           class_(Int,
                  Object,
                  single_Features(attr(val, prim_slot, no_expr())),
                  filename),
-          Basic, this));
+          Basic, NULL));
 
   //
   // Bool also has only the "val" slot.
   //
-  install_class(
+  basic_classes.push_back(
       new CgenNode(
           class_(Bool, Object, single_Features(attr(val, prim_slot, no_expr())), filename),
-          Basic, this));
+          Basic, NULL));
 
   //
   // The class Str has a number of slots and operations:
@@ -1093,7 +2060,7 @@ void CgenClassTable::install_basic_classes()
   //       concat(arg: Str) : Str               string concatenation
   //       substr(arg: Int, arg2: Int): Str     substring
   //
-  install_class(
+  basic_classes.push_back(
       new CgenNode(
           class_(Str,
                  Object,
@@ -1114,7 +2081,16 @@ void CgenClassTable::install_basic_classes()
                                             Str,
                                             no_expr()))),
                  filename),
-          Basic, this));
+          Basic, NULL));
+}
+
+void CgenClassTable::install_basic_classes()
+{
+  prepare_basic_classes();
+  for (CgenNodeP nd : special_classes)
+    install_special_class(nd);
+  for (CgenNodeP nd : basic_classes)
+    install_class(nd);
 }
 
 // CgenClassTable::install_class
@@ -1122,19 +2098,26 @@ void CgenClassTable::install_basic_classes()
 //
 // install_classes enters a list of classes in the symbol table.
 //
+void CgenClassTable::install_special_class(CgenNodeP nd)
+{
+  addid(nd->get_name(), nd);
+  sym_node[nd->get_name()] = nd;
+}
+
 void CgenClassTable::install_class(CgenNodeP nd)
 {
   Symbol name = nd->get_name();
 
-  if (probe(name))
+  if (sym_node.count(name))
   {
     return;
   }
 
   // The class name is legal, so add it to the list of classes
   // and the symbol table.
-  nds = new List<CgenNode>(nd, nds);
+  nds = arena.make<List<CgenNode>>(nd, nds);
   addid(name, nd);
+  sym_node[name] = nd;
 }
 
 void CgenClassTable::install_classes(Classes cs)
@@ -1160,14 +2143,14 @@ void CgenClassTable::build_inheritance_tree()
 //
 void CgenClassTable::set_relations(CgenNodeP nd)
 {
-  CgenNode *parent_node = probe(nd->get_parent());
+  CgenNode *parent_node = sym_node[nd->get_parent()];
   nd->set_parentnd(parent_node);
   parent_node->add_child(nd);
 }
 
 void CgenNode::add_child(CgenNodeP n)
 {
-  children = new List<CgenNode>(n, children);
+  children = arena.make<List<CgenNode>>(n, children);
 }
 
 void CgenNode::set_parentnd(CgenNodeP p)
@@ -1179,7 +2162,22 @@ void CgenNode::set_parentnd(CgenNodeP p)
 
 void CgenClassTable::code()
 {
-  
+  if (cgen_target == TARGET_X86_64) {
+    if (cgen_debug)
+      cout << "coding x86-64 data" << endl;
+    code_x86_64_data();
+
+    return;
+  }
+
+  if (cgen_target == TARGET_C) {
+    if (cgen_debug)
+      cout << "coding C data" << endl;
+    code_c_data();
+
+    return;
+  }
+
   if (cgen_debug)
     cout << "coding global data" << endl;
   code_global_data();
@@ -1206,6 +2204,10 @@ void CgenClassTable::code()
     cout << "coding class_objTab" << endl;
   code_class_objTab();
 
+  if (cgen_debug)
+    cout << "coding class_rangeTab" << endl;
+  code_class_rangeTab();
+
   if (cgen_debug)
     cout << "coding dispTab for all classes" << endl;
   code_dispTab();
@@ -1217,10 +2219,7 @@ void CgenClassTable::code()
   if (cgen_debug)
     cout << "coding global text" << endl;
   code_global_text();
-  
-  if (cgen_debug)
-    cout << "coding init for all classes" << endl;
-  code_init();
+
 
   //                 Add your code to emit
   //                   - object initializer
@@ -1247,6 +2246,183 @@ CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) : class__cl
   stringtable.add_string(name->get_string()); // Add class name to string table
 }
 
+///////////////////////////////////////////////////////////////////////
+//
+// IRBuilder methods
+//
+// The code methods of the expression nodes append the instructions
+// computing their value to the current block and return the virtual
+// register holding it: an object from code, a raw word from
+// code_unboxed.  Variables other than attributes live in a virtual
+// register, which is returned as is when the variable is read.
+//
+///////////////////////////////////////////////////////////////////////
+
+IRBuilder::IRBuilder(IRFunction &f, CgenNodeP c, CgenClassTableP t)
+  : block(-1), fn(f), curr(c), ct(t), depth(0), self(0), self_class(c), call_line(0)
+{
+  set_block(new_block());
+}
+
+int IRBuilder::new_block()
+{
+  IRBlock b;
+  b.depth = depth;
+  fn.blocks.push_back(b);
+  return fn.blocks.size() - 1;
+}
+
+void IRBuilder::set_block(int b)
+{
+  assert(block < 0);
+  block = b;
+  layout.push_back(b);
+}
+
+int IRBuilder::new_var(Symbol name, IRType t)
+{
+  int v = fn.new_vreg(t);
+  var_of.resize(fn.vregs.size(), NULL);
+  var_of[v] = name;
+  return v;
+}
+
+// The variable held in v, if any.
+Symbol IRBuilder::var(int v)
+{
+  return v < int(var_of.size()) ? var_of[v] : NULL;
+}
+
+//
+// A new variable initialized to v.  A temporary becomes the variable
+// itself; self and other variables are copied.
+//
+int IRBuilder::bind(Symbol name, int v)
+{
+  if (v != 0 && v != self && var(v) == NULL) {
+    var_of.resize(fn.vregs.size(), NULL);
+    var_of[v] = name;
+    return v;
+  }
+  int copy = new_var(name, fn.vregs[v]);
+  move(copy, v);
+  return copy;
+}
+
+int IRBuilder::emit(const IRInsn &in)
+{
+  assert(block >= 0);
+  fn.blocks[block].insns.push_back(in);
+  if (in.is_terminator())
+    block = -1;
+  return in.d;
+}
+
+int IRBuilder::def(IROp op, IRType t, int a, int b)
+{
+  IRInsn in(op);
+  in.d = fn.new_vreg(t);
+  in.a = a;
+  in.b = b;
+  return emit(in);
+}
+
+int IRBuilder::load_imm(int val)
+{
+  IRInsn in(IR_LI);
+  in.d = fn.new_vreg(IR_WORD);
+  in.imm = val;
+  return emit(in);
+}
+
+int IRBuilder::load_address(const std::string &label)
+{
+  IRInsn in(IR_LA);
+  in.d = fn.new_vreg(IR_OBJ);
+  in.label = label;
+  return emit(in);
+}
+
+void IRBuilder::move(int d, int a)
+{
+  IRInsn in(IR_MOVE);
+  in.d = d;
+  in.a = a;
+  emit(in);
+}
+
+void IRBuilder::jump(int target)
+{
+  IRInsn in(IR_JUMP);
+  in.target = target;
+  emit(in);
+}
+
+void IRBuilder::branch(int cond, int target, int other)
+{
+  IRInsn in(IR_BRANCH);
+  in.a = cond;
+  in.target = target;
+  in.other = other;
+  emit(in);
+}
+
+//
+// v is an operand that is only used after later has been evaluated.
+// If v holds a variable that later assigns to, use a copy instead.
+//
+int IRBuilder::protect(int v, Expression later)
+{
+  Symbol name = var(v);
+  if (name == NULL || !later->assigns_var(name))
+    return v;
+  return def(IR_MOVE, fn.vregs[v], v);
+}
+
+// Number the blocks in layout order.
+void IRBuilder::finish()
+{
+  assert(block < 0 && layout.size() == fn.blocks.size());
+  std::vector<int> position(fn.blocks.size());
+  std::vector<IRBlock> blocks;
+  for (size_t i = 0; i < layout.size(); i++) {
+    position[layout[i]] = i;
+    blocks.push_back(fn.blocks[layout[i]]);
+  }
+  for (IRBlock &b : blocks)
+    for (IRInsn &in : b.insns) {
+      if (in.target >= 0)
+        in.target = position[in.target];
+      if (in.other >= 0)
+        in.other = position[in.other];
+      for (int &t : in.table)
+        t = position[t];
+    }
+  fn.blocks.swap(blocks);
+}
+
+// The labels of constants.
+static std::string const_label(StringEntry *str)
+{
+  std::ostringstream s;
+  str->code_ref(s);
+  return s.str();
+}
+
+static std::string const_label(IntEntry *i)
+{
+  std::ostringstream s;
+  i->code_ref(s);
+  return s.str();
+}
+
+static std::string const_label(const BoolConst &b)
+{
+  std::ostringstream s;
+  b.code_ref(s);
+  return s.str();
+}
+
 //******************************************************************
 //
 //   Fill in the following methods to produce code for the
@@ -1257,507 +2433,1461 @@ CgenNode::CgenNode(Class_ nd, Basicness bstatus, CgenClassTableP ct) : class__cl
 //
 //*****************************************************************
 
-void method_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+void method_class::code(ostream &os, CgenNodeP curr, CgenClassTable* ct)
 {
-  // Push foramls to the symbol table
+  std::string fname = std::string(curr->name->get_string()) + METHOD_SEP + name->get_string();
+  IRFunction fn(fname, formals->len(), get_line_number());
+  IRBuilder b(fn, curr, ct);
+
+  // each formal is a variable, loaded from its argument slot
   curr->variables.enterscope();
   int index = 0;
-  Formal curr_formal;
-  int size = 0;
-  
-  for (int j = formals->first(); formals->more(j); j = formals->next(j)){
-    size++;
-  }
   for (int j = formals->first(); formals->more(j); j = formals->next(j)){
-    std::pair<int, int>* value = new std::pair<int, int>();
-    curr_formal = formals->nth(j);
-    Symbol key = curr_formal -> get_name();
-    value->first = 1;
-    value->second = (size-1) - index;
-    curr->variables.addid(key, value);
-    curr->varLen = size;
-    index++;
+    IRInsn arg(IR_ARG);
+    Symbol key = formals->nth(j) -> get_name();
+    arg.d = b.new_var(key, IR_OBJ);
+    arg.imm = index++;
+    b.emit(arg);
+    curr->variables.addid(key, arena.make<std::pair<int, int>>(1, arg.d));
   }
-    
-  // push stack pointer down
-  emit_addiu(SP, SP, -12 - (formals->len() * 4), s);
-  // push fp
-  emit_store(FP, 3, SP, s);
-  // push s0
-  emit_store("$s0", 2, SP, s);
-  // push ra
-  emit_store(RA, 1, SP, s);
-  // change FP pointer
-  emit_addiu(FP, SP, 16, s);
-  // set $s0 = ACC
-  emit_move("$s0", ACC, s);
-
-  // generate code on expression
-  expr->code(s, curr, ct);
-
-  // pop fp, s0, ra
-  emit_load(FP, 3, SP, s);
-  emit_load("$s0", 2, SP, s);
-  emit_load(RA, 1, SP, s);
-  // readjust stack pointer and return
-  emit_addiu(SP, SP, 12 + (formals->len() * 4), s);
-  emit_return(s);
 
+  IRInsn ret(IR_RETURN);
+  ret.a = expr->code(b);
+  b.emit(ret);
   curr->variables.exitscope();
-}
 
-void assign_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  expr -> code(s, curr, ct);
-  std::pair<int, int> value = *(curr->variables.lookup(name));
-  //variable is an attribute
-  if(value.first == 0) {
-    int offset = value.second;
-    emit_store(ACC, offset+3, SELF, s);
-  }
-  //variable is a formal
-  if(value.first == 1) {
-    int offset = value.second;
-    emit_store(ACC, offset, FP, s);
-  }
-  //variable is defined in let
-  if(value.first == 2) {
-    int offset = value.second;
-    emit_store(ACC, offset, FP, s);
+  b.finish();
+  if (cgen_optimize) {
+    int hoisted = 0, promoted = 0;
+    optimize_loops(fn, hoisted, promoted);
+    loop_hoisted += hoisted;
+    loop_promoted += promoted;
+    tail_calls += mark_tail_calls(fn);
   }
+  code_function(fn, curr, os);
 }
 
-void static_dispatch_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+//
+// By default an unboxed value is read out of the object; Int and Bool
+// both keep theirs in the first attribute slot.
+//
+int Expression_class::code_unboxed(IRBuilder &b)
 {
-  for (auto i = actual->first(); actual->more(i); i = actual->next(i)) {
-    actual->nth(i)->code(s, curr, ct);
-    emit_push(ACC, s);
-  }
-  expr->code(s, curr, ct);
-  // if obj == void, abort
-  emit_bne(ACC, ZERO, label_index, s);
-  emit_load_imm(T1, get_line_number(), s);
-  emit_jal("_dispatch_abort", s);
-  emit_label_def(label_index, s);
-  label_index++;
-  std::string dispatchTab = type_name->get_string();
-  dispatchTab += DISPTAB_SUFFIX;
-  emit_load_address(T1, (char *)dispatchTab.c_str(), s);
-  std::vector< std::pair<Symbol, Symbol> > disTab = sym_node[type_name]->dispatch_table;
-  int offset = 0;
-  for (int i = 0; i < int(disTab.size()); i++) {
-    std::pair<Symbol, Symbol> pair = disTab[i];
-    if (pair.first == name) {
-      emit_load(T1, i, T1, s);
-      emit_jalr(T1, s);
-    }
-  }
+  return b.def(IR_UNBOX, IR_WORD, code(b));
 }
 
-void dispatch_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+//
+// Evaluate an expression whose value is discarded.
+//
+static void code_effect(Expression e, IRBuilder &b)
 {
-  
-  for (auto i = actual->first(); actual->more(i); i = actual->next(i)) {
-    actual->nth(i)->code(s, curr, ct);
-    emit_push(ACC, s);
-  }
-
-  expr->code(s, curr, ct);
-  
-  // if obj == void, abort
-  emit_bne(ACC, ZERO, label_index, s);
-  emit_load_imm(T1, get_line_number(), s);
-  emit_jal("_dispatch_abort", s);
-  emit_label_def(label_index, s);
-  label_index++;
-  emit_load(T1, 2, ACC, s);
-  Symbol class_ = expr->get_type() == SELF_TYPE ? curr->name : expr->get_type();
-  std::vector< std::pair<Symbol, Symbol> > disTab = sym_node[class_]->dispatch_table;
-  for (int i = 0; i < int(disTab.size()); i++) {
-    std::pair<Symbol, Symbol> pair = disTab[i];
-    if (pair.first == name) {
-      emit_load(T1, i, T1, s);
-      emit_jalr(T1, s);
-    }
-  }
+  if (e->has_unboxed_code() && is_unboxed_type(e->get_type()))
+    e->code_unboxed(b);
+  else
+    e->code(b);
 }
 
-void cond_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  pred -> code(s, curr, ct);
-  emit_load(T1, 3, ACC, s);
-  int if_false = label_index++;
-  emit_beqz(T1, if_false, s);
-  then_exp -> code(s, curr, ct);
-  int end = label_index++;
-  emit_branch(end, s);
-  s << "label" << if_false << LABEL;
-  else_exp -> code(s, curr, ct);
-  s << "label" << end << LABEL;
+static int code_box(int w, Symbol type, IRBuilder &b)
+{
+  return b.def(type == Bool ? IR_BOX_BOOL : IR_BOX_INT, IR_OBJ, w);
 }
 
-void loop_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  int if_true = label_index++;
-  s << "label" << if_true << LABEL;
-  
-  pred -> code(s, curr, ct);
-  emit_load(T1, 3, ACC, s);
-  
-  int end = label_index++;
-  emit_beq(T1, ZERO, end, s);
+// Attribute index of self.
+static int code_load_attr(int index, IRBuilder &b)
+{
+  IRInsn load(IR_LOAD);
+  load.d = b.fn.new_vreg(IR_OBJ);
+  load.a = b.self;
+  load.imm = index + DEFAULT_OBJFIELDS;
+  if (b.self_class != b.curr)
+    load.label = b.self_class->name->get_string();
+  return b.emit(load);
+}
 
-  body -> code(s, curr, ct);
-  emit_branch(if_true, s);
-  
-  s << "label" << end << LABEL;
-  emit_move(ACC, ZERO, s);
+static void code_store_attr(int index, int v, IRBuilder &b)
+{
+  IRInsn store(IR_STORE);
+  store.a = b.self;
+  store.imm = index + DEFAULT_OBJFIELDS;
+  store.b = v;
+  if (b.self_class != b.curr)
+    store.label = b.self_class->name->get_string();
+  b.emit(store);
 }
 
-CgenNodeP CgenClassTable::find_class(Symbol class_name){
-  std::vector<CgenNodeP> classes_ = get_classes();
-  std::reverse(classes_.begin(), classes_.end());
-  for (CgenNodeP curr : classes_){
-    if(curr -> name == class_name){
-      return curr;
-    }
+int assign_class::code(IRBuilder &b){
+  std::pair<int, int> value = *(b.curr->variables.lookup(name));
+  //variable is an attribute
+  if(value.first == 0) {
+    int v = expr -> code(b);
+    code_store_attr(value.second, v, b);
+    return v;
+  }
+  //variable is unboxed: the box is made from its new value
+  int var = value.second;
+  if(b.fn.vregs[var] == IR_WORD) {
+    b.move(var, expr -> code_unboxed(b));
+    return code_box(var, expr->get_type(), b);
   }
+  b.move(var, expr -> code(b));
+  return var;
 }
 
-void typcase_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  expr -> code(s, curr, ct);
+int assign_class::code_unboxed(IRBuilder &b){
+  std::pair<int, int> value = *(b.curr->variables.lookup(name));
+  if(value.first == 0 || b.fn.vregs[value.second] != IR_WORD)
+    return Expression_class::code_unboxed(b);
+  b.move(value.second, expr -> code_unboxed(b));
+  return value.second;
+}
 
-  int starting_label_index = label_index;
-  emit_bne(ACC, ZERO, ++label_index, s);
-  s << LA << ACC << " str_const0" << endl;
-  s << LI << T1 << " " << get_line_number() << endl;
-  s << JAL << "_case_abort2" << endl;
+//
+// The arguments are evaluated first to last, then the receiver.
+//
+static std::vector<int> code_args(Expressions actual, Expression call, IRBuilder &b)
+{
+  std::vector<int> args;
+  for (int i = actual->first(); actual->more(i); i = actual->next(i))
+    args.push_back(b.protect(actual->nth(i)->code(b), call));
+  return args;
+}
 
-  std::vector< std::tuple< Case, int, int> > branches;
-  std::vector<Case> cases_vector;
+static int dispatch_slot(Symbol class_, Symbol name, Symbol &definer)
+{
+  CgenNodeP node = sym_node.at(class_);
+  int slot = node->dispatch_slots.at(name);
+  definer = node->dispatch_table[slot].second;
+  return slot;
+}
 
-  int num_cases = 0;
-  for (auto i = cases->first(); cases->more(i); i = cases->next(i)){
-    Case curr_case = cases->nth(i);
-    
-    cases_vector.push_back(curr_case);
-    num_cases++;
+//
+// A call bound to a method that find_inlinable chose is replaced by
+// the method's body, with self the receiver and each formal a new
+// variable holding its argument.  The body sees the attributes of the
+// method's class at their indexes in the receiver.
+//
+static int code_bound_call(IRInsn &call, Symbol definer, Symbol name, IRBuilder &b)
+{
+  CgenNodeP node = sym_node.at(definer);
+  auto m = node->inlinable.find(name);
+  if (m == node->inlinable.end()) {
+    call.d = b.fn.new_vreg(IR_OBJ);
+    return b.emit(call);
   }
-  curr->variables.enterscope();
+  method_class *method = m->second;
+  inlined++;
+
+  if (call.a != 0) {
+    IRInsn check(IR_CHECK_VOID);
+    check.a = call.a;
+    check.line = call.line;
+    b.emit(check);
+  }
+
+  b.curr->variables.enterscope();
+  for (size_t i = 0; i < node->attr_layout.size(); i++)
+    b.curr->variables.addid(node->attr_layout[i]->name, arena.make<std::pair<int, int>>(0, i));
+  Formals formals = method->formals;
+  int k = 0;
+  for (int j = formals->first(); formals->more(j); j = formals->next(j)) {
+    Symbol formal = formals->nth(j)->get_name();
+    int var = b.bind(formal, call.args[k++]);
+    b.curr->variables.addid(formal, arena.make<std::pair<int, int>>(1, var));
+  }
+  int caller_self = b.self;
+  CgenNodeP caller_class = b.self_class;
+  b.self = call.a;
+  b.self_class = node;
+  b.call_line = call.line;
+  int result = method->expr->code(b);
+  b.self = caller_self;
+  b.self_class = caller_class;
+  b.call_line = 0;
+  b.curr->variables.exitscope();
+  return result;
+}
+
+int static_dispatch_class::code(IRBuilder &b)
+{
+  IRInsn call(IR_STATIC_DISPATCH);
+  call.args = code_args(actual, this, b);
+  call.a = expr->code(b);
+  Symbol definer;
+  dispatch_slot(type_name, name, definer);
+  call.label = std::string(definer->get_string()) + METHOD_SEP + name->get_string();
+  call.line = get_line_number();
+  return code_bound_call(call, definer, name, b);
+}
+
+//
+// IO.out_int just prints its argument with a syscall.  Unless some
+// class overrides it, a call to out_int prints an unboxed argument
+// directly instead of boxing it for the runtime.
+//
+static bool is_inline_out_int(Symbol name, Expressions actual)
+{
+  if (name != out_int || actual->len() != 1)
+    return false;
+  static const bool overridden = [] {
+    for (auto &entry : sym_node) {
+      CgenNodeP node = entry.second;
+      auto slot = node->dispatch_slots.find(out_int);
+      if (slot != node->dispatch_slots.end() && node->dispatch_table[slot->second].second != IO)
+        return true;
+    }
+    return false;
+  }();
+  return !overridden;
+}
 
-  for(int i = 0; i<num_cases; i++){
+int dispatch_class::code(IRBuilder &b)
+{
+  if (is_inline_out_int(name, actual)) {
+    IRInsn print(IR_PRINT_INT);
+    print.a = b.protect(actual->nth(actual->first())->code_unboxed(b), expr);
+    print.b = expr->code(b);
+    print.line = get_line_number();
+    b.emit(print);
+    return print.b;
+  }
 
-    int max_class_tag = -1;
-    Case max_case;
+  IRInsn call(IR_DISPATCH);
+  call.args = code_args(actual, this, b);
+  call.a = expr->code(b);
+  Symbol class_ = expr->get_type() == SELF_TYPE ? b.curr->name : expr->get_type();
+  Symbol definer;
+  call.imm = dispatch_slot(class_, name, definer);
+  call.label = std::string(class_->get_string()) + METHOD_SEP + name->get_string();
+  dispatches++;
+
+  call.line = get_line_number();
+
+  // every class the object can be of has the same method
+  if (!sym_node.at(class_)->overridden[call.imm]) {
+    call.op = IR_STATIC_DISPATCH;
+    call.label = std::string(definer->get_string()) + METHOD_SEP + name->get_string();
+    devirtualized++;
+    return code_bound_call(call, definer, name, b);
+  }
+  call.d = b.fn.new_vreg(IR_OBJ);
+  return b.emit(call);
+}
 
-    int index = 0;
+static int code_cond(Expression pred, Expression then_exp, Expression else_exp,
+                     bool unboxed, IRBuilder &b)
+{
+  int p = pred -> code_unboxed(b);
+  int if_true = b.new_block(), if_false = b.new_block(), end = b.new_block();
+  b.branch(p, if_true, if_false);
+  int result = b.fn.new_vreg(unboxed ? IR_WORD : IR_OBJ);
 
-    for (Case curr_case : cases_vector){
+  b.set_block(if_true);
+  b.move(result, unboxed ? then_exp -> code_unboxed(b) : then_exp -> code(b));
+  b.jump(end);
 
-      std::pair<int, int>* value = new std::pair<int, int>();
-      Symbol key = curr_case -> get_name();
-      value->first = 2;
-      value->second = index;
-      curr->variables.addid(key, value);
-      index++;
+  b.set_block(if_false);
+  b.move(result, unboxed ? else_exp -> code_unboxed(b) : else_exp -> code(b));
+  b.jump(end);
 
-      int curr_class_tag = ct -> get_class_tag(curr_case->get_type());
-      if(curr_class_tag > max_class_tag){
-        max_class_tag = curr_class_tag;
-        max_case = curr_case;
-      }
-    }
+  b.set_block(end);
+  return result;
+}
 
-    auto it = std::find(cases_vector.begin(), cases_vector.end(), max_case);
-      if (it != cases_vector.end()) {
-        cases_vector.erase(it);
-      }
+int cond_class::code(IRBuilder &b){
+  return code_cond(pred, then_exp, else_exp, false, b);
+}
 
-    Symbol max_case_type = max_case -> get_type();
-    CgenNodeP curr_type_node = ct -> find_class(max_case_type);
+int cond_class::code_unboxed(IRBuilder &b){
+  return code_cond(pred, then_exp, else_exp, true, b);
+}
 
-    List<CgenNode> *children = curr_type_node -> get_children();
-    int max_tag_child = max_class_tag;
+int loop_class::code(IRBuilder &b){
+  b.depth++;
+  int head = b.new_block(), loop_body = b.new_block();
+  b.depth--;
+  int end = b.new_block();
+  b.jump(head);
 
-    CgenNodeP max_child;
+  b.depth++;
+  b.set_block(head);
+  b.branch(pred -> code_unboxed(b), loop_body, end);
+  b.set_block(loop_body);
+  code_effect(body, b);
+  b.jump(head);
+  b.depth--;
 
-    while(children != NULL){
-    for (List<CgenNode> *l = children; l; l = l->tl()){
-      CgenNodeP child = l->hd();
-      int tag_child = ct -> get_class_tag(child -> name);
-      if(tag_child > max_tag_child){
-        max_tag_child = tag_child;
-        max_child = child;
-      } 
-    }
+  b.set_block(end);
+  return b.def(IR_LI, IR_OBJ);
+}
 
-    children = max_child -> get_children();
-    }
+//
+// A case goes to the branch for the object's class tag in one step.
+// Every tag is given the branch for its closest ancestor among the
+// branches' classes, or none, and the tags from 0 up then fall into
+// runs of consecutive tags that go to the same block.  A case with
+// enough runs and few enough tags outside them jumps through a table
+// indexed by the tag; any other finds the tag's run by binary search.
+//
+struct TagRun
+{
+  int first;              // its first tag; it ends where the next begins
+  int block;
+};
 
+#define MIN_TABLE_RUNS 5
+#define MIN_TABLE_DENSITY 3     // no more than 1 in 3 entries to no_match
 
-    std::tuple< Case, int, int> item;
-    item = std::make_tuple(max_case, max_class_tag, max_tag_child);
-    branches.push_back(item);
+// Branches to the block of the run of runs[i, j) that the tag is in.
+static void code_tag_search(int tag, const std::vector<TagRun> &runs, size_t i, size_t j,
+                            IRBuilder &b)
+{
+  size_t mid = (i + j) / 2;
+  int low = mid - i == 1 ? runs[i].block : b.new_block();
+  int high = j - mid == 1 ? runs[mid].block : b.new_block();
+  b.branch(b.def(IR_LT, IR_WORD, tag, b.load_imm(runs[mid].first)), low, high);
+  if (mid - i > 1) {
+    b.set_block(low);
+    code_tag_search(tag, runs, i, mid, b);
   }
-  label_index++;
-  int j = 1;
-  int top_label_index = starting_label_index + 1;
-  for (auto &my_tuple : branches){
-    s << "label" << top_label_index << LABEL;
-    if(j ==  1){
-      emit_load(T2, 0, ACC, s);
-    }
-    emit_blti(T2, std::get<1>(my_tuple), label_index, s);
-    emit_bgti(T2, std::get<2>(my_tuple), label_index, s);
-    
-    top_label_index = label_index;
-    
-    label_index++;
-    j++;
-    Expression expr = std::get<0>(my_tuple) -> get_expression();
-    expr -> code(s, curr, ct);
-    s << BRANCH << "label" << starting_label_index << endl;  
+  if (j - mid > 1) {
+    b.set_block(high);
+    code_tag_search(tag, runs, mid, j, b);
   }
-  s << "label" << top_label_index << LABEL;
-  s << JAL << "_case_abort" << endl;
-  s << "label" << starting_label_index << LABEL;
+}
 
-  curr->variables.exitscope();
+static void code_tag_switch(int tag, const std::vector<TagRun> &runs, int no_match, IRBuilder &b)
+{
+  if (runs.size() == 1) {
+    b.jump(runs[0].block);
+    return;
+  }
+
+  // the table leaves out the runs to no_match at either end
+  size_t i = runs[0].block == no_match ? 1 : 0;
+  size_t j = runs.back().block == no_match ? runs.size() - 1 : runs.size();
+  int low = runs[i].first;
+  int high = j < runs.size() ? runs[j].first : b.ct->classes_ordered.size();
+  int missing = 0;
+  for (size_t k = i; k < j; k++)
+    if (runs[k].block == no_match)
+      missing += (k + 1 < runs.size() ? runs[k + 1].first : high) - runs[k].first;
+  if (j - i < MIN_TABLE_RUNS || missing * MIN_TABLE_DENSITY > high - low) {
+    code_tag_search(tag, runs, 0, runs.size(), b);
+    return;
+  }
 
+  IRInsn sw(IR_SWITCH);
+  sw.a = tag;
+  sw.imm = low;
+  sw.other = no_match;
+  for (size_t k = i; k < j; k++) {
+    int end = k + 1 < runs.size() ? runs[k + 1].first : high;
+    sw.table.insert(sw.table.end(), end - runs[k].first, runs[k].block);
+  }
+  b.emit(sw);
+}
+
+int typcase_class::code(IRBuilder &b){
+  int obj = expr -> code(b);
+  int on_void = b.new_block(), test = b.new_block();
+  b.branch(b.def(IR_ISVOID, IR_WORD, obj), on_void, test);
+  b.set_block(on_void);
+  IRInsn abort_void(IR_ABORT_CASE_VOID);
+  abort_void.line = get_line_number();
+  b.emit(abort_void);
+
+  b.set_block(test);
+  IRInsn load_tag(IR_LOAD);
+  load_tag.d = b.fn.new_vreg(IR_WORD);
+  load_tag.a = obj;
+  load_tag.imm = TAG_OFFSET;
+  int tag = b.emit(load_tag);
+
+  std::vector<Case> branches;
+  for (int i = cases->first(); cases->more(i); i = cases->next(i))
+    branches.push_back(cases->nth(i));
+  std::vector<int> matches;
+  for (size_t i = 0; i < branches.size(); i++)
+    matches.push_back(b.new_block());
+  int no_match = b.new_block();
+
+  // the branches' tag ranges nest; sorted by first tag, outer first
+  std::vector<std::pair<CgenNodeP, int> > ranges;
+  for (size_t i = 0; i < branches.size(); i++)
+    ranges.push_back(std::make_pair(b.ct->find_class(branches[i]->get_type()), matches[i]));
+  std::sort(ranges.begin(), ranges.end(), [](const std::pair<CgenNodeP, int> &x,
+                                             const std::pair<CgenNodeP, int> &y) {
+    return x.first->tag < y.first->tag ||
+           (x.first->tag == y.first->tag && x.first->max_tag > y.first->max_tag);
+  });
+
+  // a tag goes to the innermost range it is in
+  int ntags = b.ct->classes_ordered.size();
+  std::vector<TagRun> runs;
+  auto run = [&](int first, int block) {
+    if (first >= ntags)
+      return;
+    if (!runs.empty() && runs.back().first == first)
+      runs.pop_back();
+    if (runs.empty() || runs.back().block != block)
+      runs.push_back(TagRun{first, block});
+  };
+  std::vector<std::pair<int, int> > open(1, std::make_pair(ntags - 1, no_match));
+  run(0, no_match);
+  for (auto &r : ranges) {
+    while (open.back().first < r.first->tag) {
+      int last = open.back().first;
+      open.pop_back();
+      run(last + 1, open.back().second);
+    }
+    run(r.first->tag, r.second);
+    open.push_back(std::make_pair(r.first->max_tag, r.second));
+  }
+  while (open.size() > 1) {
+    int last = open.back().first;
+    open.pop_back();
+    run(last + 1, open.back().second);
+  }
+  code_tag_switch(tag, runs, no_match, b);
+
+  b.set_block(no_match);
+  IRInsn abort(IR_ABORT_CASE);
+  abort.a = obj;
+  b.emit(abort);
+
+  int result = b.fn.new_vreg(IR_OBJ), end = b.new_block();
+  for (size_t i = 0; i < branches.size(); i++) {
+    b.set_block(matches[i]);
+    Symbol name = branches[i]->get_name();
+    int var = b.new_var(name, IR_OBJ);
+    b.move(var, obj);
+    b.curr->variables.enterscope();
+    b.curr->variables.addid(name, arena.make<std::pair<int, int>>(1, var));
+    b.move(result, branches[i]->get_expression()->code(b));
+    b.curr->variables.exitscope();
+    b.jump(end);
+  }
+  b.set_block(end);
+  return result;
 }
 
-void block_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
+int block_class::code(IRBuilder &b)
+{
+  int result = -1;
   for (int i = body->first(); body->more(i); i = body->next(i)) {
-    body->nth(i)->code(s, curr, ct);
+    if (body->more(body->next(i)))
+      code_effect(body->nth(i), b);
+    else
+      result = body->nth(i)->code(b);
   }
+  return result;
 }
 
-void let_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  if (init->type != nullptr) {
-    init->code(s, curr, ct);
-  } else if (type_decl == Str) {
-    emit_load_string(ACC, stringtable.lookup_string(""), s);
-  } else if (type_decl == Int) {
-    emit_load_int(ACC, inttable.lookup_string("0"), s);
-  } else if (type_decl == Bool) {
-    emit_load_bool(ACC, falsebool, s);
-  } else {
-    emit_move(ACC, ZERO, s);
+int block_class::code_unboxed(IRBuilder &b)
+{
+  int result = -1;
+  for (int i = body->first(); body->more(i); i = body->next(i)) {
+    if (body->more(body->next(i)))
+      code_effect(body->nth(i), b);
+    else
+      result = body->nth(i)->code_unboxed(b);
   }
-  curr->variables.enterscope();
-  std::pair<int, int>* value = new std::pair<int, int>();
-  Symbol key = identifier;
-  value->first = 2;
-  value->second = curr->varLen;
-  curr->varLen++;
-  curr->variables.addid(key, value);
-  emit_push(ACC, s);
-  body->code(s, curr, ct);
-  curr->varLen--;
-  curr->variables.exitscope();
-  emit_load("$s1", 1, FP, s);
+  return result;
 }
 
-void plus_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_jal("Object.copy", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load(T1, 3, "$s1", s);
-  emit_add(T1, T1, T2, s);
-  emit_store(T1, 3, ACC, s);
-  emit_load("$s1", 1, FP, s);
+// The value of a variable declared without an initializer.
+static int code_default(Symbol type, IRBuilder &b)
+{
+  if (type == Str)
+    return b.load_address(const_label(stringtable.lookup_string("")));
+  if (type == Int)
+    return b.load_address(const_label(inttable.lookup_string("0")));
+  if (type == Bool)
+    return b.load_address(const_label(falsebool));
+  return b.def(IR_LI, IR_OBJ);
 }
 
-void sub_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_jal("Object.copy", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load(T1, 3, "$s1", s);
-  emit_sub(T1, T1, T2, s);
-  emit_store(T1, 3, ACC, s);
-  emit_load("$s1", 1, FP, s);
+//
+// The variable is kept unboxed when it is an Int or Bool that the body
+// never reads as an object.
+//
+static int code_let(Symbol identifier, Symbol type_decl, Expression init,
+                    Expression body, bool unboxed_result, IRBuilder &b)
+{
+  bool unboxed = is_unboxed_type(type_decl) && !body->boxes_var(identifier);
+  int v;
+  if (unboxed)
+    v = init->is_no_expr() ? b.load_imm(0) : init->code_unboxed(b);
+  else
+    v = init->is_no_expr() ? code_default(type_decl, b) : init->code(b);
+
+  b.curr->variables.enterscope();
+  b.curr->variables.addid(identifier, arena.make<std::pair<int, int>>(1, b.bind(identifier, v)));
+  int result = unboxed_result ? body->code_unboxed(b) : body->code(b);
+  b.curr->variables.exitscope();
+  return result;
 }
 
-void mul_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+int let_class::code(IRBuilder &b)
 {
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_jal("Object.copy", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load(T1, 3, "$s1", s);
-  emit_mul(T1, T1, T2, s);
-  emit_store(T1, 3, ACC, s);
-  emit_load("$s1", 1, FP, s);
+  return code_let(identifier, type_decl, init, body, false, b);
 }
 
-void divide_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+int let_class::code_unboxed(IRBuilder &b)
 {
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_jal("Object.copy", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load(T1, 3, "$s1", s);
-  emit_div(T1, T1, T2, s);
-  emit_store(T1, 3, ACC, s);
-  emit_load("$s1", 1, FP, s);
+  return code_let(identifier, type_decl, init, body, true, b);
 }
 
-void neg_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  e1->code(s, curr, ct);
-  emit_jal("Object.copy", s);
-  emit_load(T1, 3, ACC, s);
-  emit_neg(T1, T1, s);
-  emit_store(T1, 3, ACC, s);
+//
+// Evaluate the operands of an Int or Bool operator unboxed and apply
+// it.  The left operand is copied if the right one assigns to the
+// variable it is read from.  The instruction records the line for
+// arithmetic errors, or, in an inlined body, the line of the call.
+//
+static int code_operator(IROp op, Expression e1, Expression e2, int line, IRBuilder &b)
+{
+  IRInsn in(op);
+  in.a = b.protect(e1->code_unboxed(b), e2);
+  in.b = e2->code_unboxed(b);
+  in.d = b.fn.new_vreg(IR_WORD);
+  in.line = b.call_line ? b.call_line : line;
+  return b.emit(in);
 }
 
-void lt_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_load(T1, 3, "$s1", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load_bool(ACC, BoolConst(1), s);
-  emit_blt(T1, T2, label_index, s);
-  emit_load_bool(ACC, BoolConst(0), s);
-  emit_label_def(label_index, s);
-  label_index++;
-  emit_load("$s1", 1, FP, s);
-}
-
-void eq_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_move(T1, "$s1", s);
-  emit_move(T2, ACC, s);
-  emit_load_bool(ACC, BoolConst(1), s);
-  emit_beq(T1, T2, label_index, s);
-  emit_load_bool(ACC, BoolConst(0), s);
-  emit_jal("equality_test", s);
-  emit_label_def(label_index, s);
-  label_index++;
-  emit_load("$s1", 1, FP, s);
-}
-
-void leq_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_store("$s1", 1, FP, s);
-  e1->code(s, curr, ct);
-  emit_move("$s1", ACC, s);
-  e2->code(s, curr, ct);
-  emit_load(T1, 3, "$s1", s);
-  emit_load(T2, 3, ACC, s);
-  emit_load_bool(ACC, BoolConst(1), s);
-  emit_bleq(T1, T2, label_index, s);
-  emit_load_bool(ACC, BoolConst(0), s);
-  emit_label_def(label_index, s);
-  label_index++;
-  emit_load("$s1", 1, FP, s);
-}
-
-void comp_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{
-  int prev = label_index;
-  int end = label_index++;
-  e1->code(s, curr, ct);
-  emit_load(T1, 3, ACC, s);
-  emit_load_bool(ACC, BoolConst(0), s);
-  emit_beqz(T1, prev, s);
-  emit_load_bool(ACC, BoolConst(1), s);
-  emit_label_def(end, s);
-}
-
-void int_const_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+//
+// Arithmetic is done unboxed; only a result that escapes gets an Int
+// object.
+//
+int plus_class::code(IRBuilder &b)
 {
-  //
-  // Need to be sure we have an IntEntry *, not an arbitrary Symbol
-  //
-  emit_load_int(ACC, inttable.lookup_string(token->get_string()), s);
+  return code_box(code_unboxed(b), Int, b);
 }
 
-void string_const_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
+int plus_class::code_unboxed(IRBuilder &b)
 {
-  emit_load_string(ACC, stringtable.lookup_string(token->get_string()), s);
+  return code_operator(IR_ADD, e1, e2, get_line_number(), b);
 }
 
-void bool_const_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_load_bool(ACC, BoolConst(val), s);
+int sub_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Int, b);
 }
 
-void new__class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  if(type_name != SELF_TYPE){
-    s << LA << ACC << " " << type_name << PROTOBJ_SUFFIX << endl;
-    emit_jal("Object.copy", s);
-    s << JAL << type_name  << CLASSINIT_SUFFIX << endl;
-  }
-  else{
-    s << LA << T1 << "class_objTab" <<endl;
-    emit_load(T2, 0, SELF, s);
-    s << SLL << T2 << " " << T2 << " "<< "3" << endl;
-    s << ADDU << T1 << " " << T1 << " " << T2 << endl;
-    emit_push(T1, s);
-    emit_load(ACC, 0, T1, s);
-    emit_jal("Object.copy", s);
-    emit_load(T1, 1, SP, s);
-    emit_addiu(SP, SP, 4, s);
-    s << JALR << T1 << endl;
-  }
+int sub_class::code_unboxed(IRBuilder &b)
+{
+  return code_operator(IR_SUB, e1, e2, get_line_number(), b);
 }
 
-void isvoid_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  e1->code(s, curr, ct);
-  emit_load(T1, 3, ACC, s);
-  emit_load_bool(ACC, BoolConst(0), s);
-  emit_bne(T1, ZERO, label_index, s);
-  emit_load_bool(ACC, BoolConst(1), s);
-  emit_label_def(label_index, s);
-  label_index++;
+int mul_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Int, b);
 }
 
-void no_expr_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct)
-{ 
-  emit_move(ACC, ZERO, s);
+int mul_class::code_unboxed(IRBuilder &b)
+{
+  return code_operator(IR_MUL, e1, e2, get_line_number(), b);
 }
 
-void object_class::code(ostream &s, CgenNodeP curr, CgenClassTable* ct){
-  if (name == self) {
-    emit_move(ACC, SELF, s);
-  }
-  else{
-    std::pair<int, int> value = *(curr->variables.lookup(name));
-    //variable is an attribute
-    if(value.first == 0) {
-      int offset = value.second;
-      emit_load(ACC, offset+3, SELF, s);
-    }
-    //variable is a formal
-    if(value.first == 1) {
-      int offset = value.second;
-      emit_load(ACC, offset, FP, s);
-    }
-    //variable is defined in let or case
-    if(value.first == 2) {
-      int offset = value.second;
-      emit_load(ACC, offset, FP, s);
-    }
-  }
+int divide_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Int, b);
+}
+
+int divide_class::code_unboxed(IRBuilder &b)
+{
+  return code_operator(IR_DIV, e1, e2, get_line_number(), b);
+}
+
+int neg_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Int, b);
+}
+
+int neg_class::code_unboxed(IRBuilder &b)
+{
+  IRInsn in(IR_NEG);
+  in.a = e1->code_unboxed(b);
+  in.d = b.fn.new_vreg(IR_WORD);
+  in.line = b.call_line ? b.call_line : get_line_number();
+  return b.emit(in);
+}
+
+int lt_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Bool, b);
+}
+
+int lt_class::code_unboxed(IRBuilder &b)
+{
+  return code_operator(IR_LT, e1, e2, get_line_number(), b);
+}
+
+//
+// Int and Bool values are compared unboxed.  Other objects go to
+// equality_test.
+//
+int eq_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Bool, b);
+}
+
+int eq_class::code_unboxed(IRBuilder &b)
+{
+  if (is_unboxed_type(e1->get_type()))
+    return code_operator(IR_EQ, e1, e2, get_line_number(), b);
+  int left = b.protect(e1->code(b), e2);
+  return b.def(IR_OBJ_EQ, IR_WORD, left, e2->code(b));
+}
+
+int leq_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Bool, b);
+}
+
+int leq_class::code_unboxed(IRBuilder &b)
+{
+  return code_operator(IR_LE, e1, e2, get_line_number(), b);
+}
+
+int comp_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Bool, b);
+}
+
+int comp_class::code_unboxed(IRBuilder &b)
+{
+  return b.def(IR_NOT, IR_WORD, e1->code_unboxed(b));
+}
+
+int int_const_class::code(IRBuilder &b)
+{
+  //
+  // Need to be sure we have an IntEntry *, not an arbitrary Symbol
+  //
+  return b.load_address(const_label(inttable.lookup_string(token->get_string())));
+}
+
+int int_const_class::code_unboxed(IRBuilder &b)
+{
+  return b.load_imm(atoi(token->get_string()));
+}
+
+int string_const_class::code(IRBuilder &b)
+{
+  return b.load_address(const_label(stringtable.lookup_string(token->get_string())));
+}
+
+int bool_const_class::code(IRBuilder &b)
+{
+  return b.load_address(const_label(BoolConst(val)));
+}
+
+int bool_const_class::code_unboxed(IRBuilder &b)
+{
+  return b.load_imm(val);
+}
+
+int new__class::code(IRBuilder &b){
+  if(type_name == SELF_TYPE)
+    return b.def(IR_NEW_SELF, IR_OBJ);
+  CgenNodeP cls = sym_node.at(type_name);
+  init_calls++;
+  if (cls->trivial_init)
+    init_calls_removed++;
+  IRInsn alloc(cls->trivial_init ? IR_NEW_PROTO : IR_NEW);
+  alloc.d = b.fn.new_vreg(IR_OBJ);
+  alloc.label = type_name->get_string();
+  alloc.imm = DEFAULT_OBJFIELDS + cls->attr_layout.size();
+  return b.emit(alloc);
+}
+
+int isvoid_class::code(IRBuilder &b)
+{
+  return code_box(code_unboxed(b), Bool, b);
+}
+
+int isvoid_class::code_unboxed(IRBuilder &b)
+{
+  return b.def(IR_ISVOID, IR_WORD, e1->code(b));
+}
+
+int no_expr_class::code(IRBuilder &b)
+{
+  return b.def(IR_LI, IR_OBJ);
+}
+
+int object_class::code(IRBuilder &b){
+  if (name == self)
+    return b.self;
+  std::pair<int, int> value = *(b.curr->variables.lookup(name));
+  //variable is an attribute
+  if(value.first == 0)
+    return code_load_attr(value.second, b);
+  //variable is an unboxed let variable
+  if(b.fn.vregs[value.second] == IR_WORD)
+    return code_box(value.second, get_type(), b);
+  return value.second;
+}
+
+int object_class::code_unboxed(IRBuilder &b){
+  std::pair<int, int> value = *(b.curr->variables.lookup(name));
+  if(value.first == 1 && b.fn.vregs[value.second] == IR_WORD)
+    return value.second;
+  return Expression_class::code_unboxed(b);
+}
+
+//******************************************************************
+//
+//   boxes_var(name) tells whether evaluating an expression needs the
+//   value of variable name as an object.  Operands that are taken
+//   unboxed don't; code_let keeps a variable unboxed when its body
+//   doesn't.
+//
+//*****************************************************************
+
+static bool operand_boxes_var(Expression e, Symbol name)
+{
+  return e->var_name() != name && e->boxes_var(name);
+}
+
+static bool list_boxes_var(Expressions es, Symbol name)
+{
+  for (int i = es->first(); es->more(i); i = es->next(i))
+    if (es->nth(i)->boxes_var(name))
+      return true;
+  return false;
+}
+
+bool assign_class::boxes_var(Symbol n)
+{
+  return expr->boxes_var(n);
+}
+
+bool static_dispatch_class::boxes_var(Symbol n)
+{
+  return list_boxes_var(actual, n) || expr->boxes_var(n);
+}
+
+bool dispatch_class::boxes_var(Symbol n)
+{
+  if (is_inline_out_int(name, actual))
+    return operand_boxes_var(actual->nth(actual->first()), n) || expr->boxes_var(n);
+  return list_boxes_var(actual, n) || expr->boxes_var(n);
+}
+
+bool cond_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(pred, n) || then_exp->boxes_var(n) || else_exp->boxes_var(n);
+}
+
+bool loop_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(pred, n) || operand_boxes_var(body, n);
+}
+
+bool typcase_class::boxes_var(Symbol n)
+{
+  if (expr->boxes_var(n))
+    return true;
+  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    Case branch = cases->nth(i);
+    if (branch->get_name() != n && branch->get_expression()->boxes_var(n))
+      return true;
+  }
+  return false;
+}
+
+bool block_class::boxes_var(Symbol n)
+{
+  for (int i = body->first(); body->more(i); i = body->next(i)) {
+    Expression e = body->nth(i);
+    if (body->more(body->next(i)) ? operand_boxes_var(e, n) : e->boxes_var(n))
+      return true;
+  }
+  return false;
+}
+
+bool let_class::boxes_var(Symbol n)
+{
+  return init->boxes_var(n) || (identifier != n && body->boxes_var(n));
+}
+
+bool plus_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool sub_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool mul_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool divide_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool neg_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n);
+}
+
+bool lt_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool eq_class::boxes_var(Symbol n)
+{
+  if (is_unboxed_type(e1->get_type()))
+    return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+  return e1->boxes_var(n) || e2->boxes_var(n);
+}
+
+bool leq_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n) || operand_boxes_var(e2, n);
+}
+
+bool comp_class::boxes_var(Symbol n)
+{
+  return operand_boxes_var(e1, n);
+}
+
+bool int_const_class::boxes_var(Symbol n)
+{
+  return false;
+}
+
+bool string_const_class::boxes_var(Symbol n)
+{
+  return false;
+}
+
+bool bool_const_class::boxes_var(Symbol n)
+{
+  return false;
+}
+
+bool new__class::boxes_var(Symbol n)
+{
+  return false;
+}
+
+bool isvoid_class::boxes_var(Symbol n)
+{
+  return e1->boxes_var(n);
+}
+
+bool no_expr_class::boxes_var(Symbol n)
+{
+  return false;
+}
+
+bool object_class::boxes_var(Symbol n)
+{
+  return name == n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Constant folding
+//
+// fold(env) returns the expression with its constant subexpressions
+// evaluated.  Folded Ints are added to inttable, so they are emitted
+// with the other int_const labels, and an if with a constant predicate
+// is replaced by the branch it takes.  A let variable initialized to
+// an Int or Bool constant and never assigned in its body is
+// propagated into the body through env.
+//
+// Nothing that would fail at run time is folded: additions and
+// subtractions that overflow (MIPS add and sub trap) and divisions by
+// zero are left for the program to execute.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void CgenClassTable::fold_constants()
+{
+  for (CgenNodeP curr : get_classes()) {
+    if (curr->basic())
+      continue;
+    Features curfs = curr->features;
+    for (int i = curfs->first(); curfs->more(i); i = curfs->next(i)) {
+      ConstEnv env;
+      env.enterscope();
+      Feature feature = curfs->nth(i);
+      if (feature->is_method()) {
+        method_class *method = (method_class *)feature;
+        method->expr = method->expr->fold(env);
+      } else {
+        attr_class *attr = (attr_class *)feature;
+        attr->init = attr->init->fold(env);
+      }
+      env.exitscope();
+    }
+  }
+}
+
+bool int_const_class::int_value(int &v)
+{
+  v = atoi(token->get_string());
+  return true;
+}
+
+static Expression make_int(int v, Expression at)
+{
+  node_lineno = at->get_line_number();
+  return int_const(inttable.add_int(v))->set_type(Int);
+}
+
+static Expression make_bool(bool v, Expression at)
+{
+  node_lineno = at->get_line_number();
+  return bool_const(v)->set_type(Bool);
+}
+
+static Expressions fold_list(Expressions es, ConstEnv &env)
+{
+  Expressions folded = nil_Expressions();
+  for (int i = es->first(); es->more(i); i = es->next(i))
+    folded = append_Expressions(folded, single_Expressions(es->nth(i)->fold(env)));
+  return folded;
+}
+
+static bool list_assigns_var(Expressions es, Symbol name)
+{
+  for (int i = es->first(); es->more(i); i = es->next(i))
+    if (es->nth(i)->assigns_var(name))
+      return true;
+  return false;
+}
+
+Expression assign_class::fold(ConstEnv &env)
+{
+  expr = expr->fold(env);
+  return this;
+}
+
+Expression static_dispatch_class::fold(ConstEnv &env)
+{
+  actual = fold_list(actual, env);
+  expr = expr->fold(env);
+  return this;
+}
+
+Expression dispatch_class::fold(ConstEnv &env)
+{
+  actual = fold_list(actual, env);
+  expr = expr->fold(env);
+  return this;
+}
+
+//
+// The branch taken keeps the type of the conditional, so that code
+// generated for the enclosing expression is unchanged.
+//
+Expression cond_class::fold(ConstEnv &env)
+{
+  bool p;
+  pred = pred->fold(env);
+  if (pred->bool_value(p))
+    return (p ? then_exp : else_exp)->fold(env)->set_type(type);
+  then_exp = then_exp->fold(env);
+  else_exp = else_exp->fold(env);
+  return this;
+}
+
+Expression loop_class::fold(ConstEnv &env)
+{
+  pred = pred->fold(env);
+  body = body->fold(env);
+  return this;
+}
+
+Expression typcase_class::fold(ConstEnv &env)
+{
+  expr = expr->fold(env);
+  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    branch_class *branch = (branch_class *)cases->nth(i);
+    env.enterscope();
+    env.addid(branch->name, NULL);
+    branch->expr = branch->expr->fold(env);
+    env.exitscope();
+  }
+  return this;
+}
+
+Expression block_class::fold(ConstEnv &env)
+{
+  body = fold_list(body, env);
+  return this;
+}
+
+Expression let_class::fold(ConstEnv &env)
+{
+  int i;
+  bool b;
+  init = init->fold(env);
+  env.enterscope();
+  if ((init->int_value(i) || init->bool_value(b)) && !body->assigns_var(identifier))
+    env.addid(identifier, init);
+  else
+    env.addid(identifier, NULL);
+  body = body->fold(env);
+  env.exitscope();
+  return this;
+}
+
+Expression plus_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b)) {
+    long long r = (long long)a + b;
+    if (r == (int)r)
+      return make_int(r, this);
+  }
+  return this;
+}
+
+Expression sub_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b)) {
+    long long r = (long long)a - b;
+    if (r == (int)r)
+      return make_int(r, this);
+  }
+  return this;
+}
+
+// mul keeps the low word of the product, as the MIPS instruction does
+Expression mul_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b))
+    return make_int((int)((unsigned)a * (unsigned)b), this);
+  return this;
+}
+
+Expression divide_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b) && b != 0 && !(a == INT_MIN && b == -1))
+    return make_int(a / b, this);
+  return this;
+}
+
+Expression neg_class::fold(ConstEnv &env)
+{
+  int a;
+  e1 = e1->fold(env);
+  if (e1->int_value(a) && a != INT_MIN)
+    return make_int(-a, this);
+  return this;
+}
+
+Expression lt_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b))
+    return make_bool(a < b, this);
+  return this;
+}
+
+Expression eq_class::fold(ConstEnv &env)
+{
+  int a, b;
+  bool p, q;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b))
+    return make_bool(a == b, this);
+  if (e1->bool_value(p) && e2->bool_value(q))
+    return make_bool(p == q, this);
+  return this;
+}
+
+Expression leq_class::fold(ConstEnv &env)
+{
+  int a, b;
+  e1 = e1->fold(env);
+  e2 = e2->fold(env);
+  if (e1->int_value(a) && e2->int_value(b))
+    return make_bool(a <= b, this);
+  return this;
+}
+
+Expression comp_class::fold(ConstEnv &env)
+{
+  bool p;
+  e1 = e1->fold(env);
+  if (e1->bool_value(p))
+    return make_bool(!p, this);
+  return this;
+}
+
+Expression int_const_class::fold(ConstEnv &env)
+{
+  return this;
+}
+
+Expression string_const_class::fold(ConstEnv &env)
+{
+  return this;
+}
+
+Expression bool_const_class::fold(ConstEnv &env)
+{
+  return this;
+}
+
+Expression new__class::fold(ConstEnv &env)
+{
+  return this;
+}
+
+Expression isvoid_class::fold(ConstEnv &env)
+{
+  e1 = e1->fold(env);
+  return this;
+}
+
+Expression no_expr_class::fold(ConstEnv &env)
+{
+  return this;
+}
+
+//
+// A propagated constant gets a node of its own, with the type of the
+// variable it replaces.
+//
+Expression object_class::fold(ConstEnv &env)
+{
+  int i;
+  bool b;
+  Expression value = env.lookup(name);
+  if (value == NULL)
+    return this;
+  if (value->int_value(i))
+    return make_int(i, this)->set_type(type);
+  if (value->bool_value(b))
+    return make_bool(b, this)->set_type(type);
+  return this;
+}
+
+//
+// assigns_var(name) tells whether an expression may assign variable
+// name; let folding only propagates variables that are never assigned.
+//
+bool assign_class::assigns_var(Symbol n)
+{
+  return name == n || expr->assigns_var(n);
+}
+
+bool static_dispatch_class::assigns_var(Symbol n)
+{
+  return list_assigns_var(actual, n) || expr->assigns_var(n);
+}
+
+bool dispatch_class::assigns_var(Symbol n)
+{
+  return list_assigns_var(actual, n) || expr->assigns_var(n);
+}
+
+bool cond_class::assigns_var(Symbol n)
+{
+  return pred->assigns_var(n) || then_exp->assigns_var(n) || else_exp->assigns_var(n);
+}
+
+bool loop_class::assigns_var(Symbol n)
+{
+  return pred->assigns_var(n) || body->assigns_var(n);
+}
+
+bool typcase_class::assigns_var(Symbol n)
+{
+  if (expr->assigns_var(n))
+    return true;
+  for (int i = cases->first(); cases->more(i); i = cases->next(i)) {
+    Case branch = cases->nth(i);
+    if (branch->get_name() != n && branch->get_expression()->assigns_var(n))
+      return true;
+  }
+  return false;
+}
+
+bool block_class::assigns_var(Symbol n)
+{
+  return list_assigns_var(body, n);
+}
+
+bool let_class::assigns_var(Symbol n)
+{
+  return init->assigns_var(n) || (identifier != n && body->assigns_var(n));
+}
+
+bool plus_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool sub_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool mul_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool divide_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool neg_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n);
+}
+
+bool lt_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool eq_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool leq_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n) || e2->assigns_var(n);
+}
+
+bool comp_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n);
+}
+
+bool int_const_class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+bool string_const_class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+bool bool_const_class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+bool new__class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+bool isvoid_class::assigns_var(Symbol n)
+{
+  return e1->assigns_var(n);
+}
+
+bool no_expr_class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+bool object_class::assigns_var(Symbol n)
+{
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Inlining
+//
+// With -O, a method whose body has at most cgen_inline nodes and
+// makes no call (so it cannot recurse) is inlined wherever a call is
+// bound to it: at a static dispatch, or at a dispatch that class
+// hierarchy analysis binds (see code_bound_call).  Bodies with a case
+// or a new SELF_TYPE, which depend on the class they are coded in,
+// are not inlined either.
+//
+// inline_size() is the number of nodes in an expression, or NO_INLINE
+// if it cannot be inlined.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#define NO_INLINE (1 << 20)
+
+void CgenClassTable::find_inlinable()
+{
+  if (cgen_inline <= 0)
+    return;
+  for (CgenNodeP curr : get_classes()) {
+    if (curr->basic())
+      continue;
+    Features curfs = curr->features;
+    for (int i = curfs->first(); curfs->more(i); i = curfs->next(i)) {
+      Feature feature = curfs->nth(i);
+      if (feature->is_method()) {
+        method_class *method = (method_class *)feature;
+        if (method->expr->inline_size() <= cgen_inline)
+          curr->inlinable[method->name] = method;
+      }
+    }
+  }
+}
+
+static int add_size(int a, int b)
+{
+  return std::min(a + b, NO_INLINE);
+}
+
+static int list_inline_size(Expressions es)
+{
+  int size = 1;
+  for (int i = es->first(); es->more(i); i = es->next(i))
+    size = add_size(size, es->nth(i)->inline_size());
+  return size;
+}
+
+int assign_class::inline_size()
+{
+  return add_size(1, expr->inline_size());
+}
+
+int static_dispatch_class::inline_size()
+{
+  return NO_INLINE;
+}
+
+int dispatch_class::inline_size()
+{
+  return NO_INLINE;
+}
+
+int cond_class::inline_size()
+{
+  return add_size(add_size(1, pred->inline_size()),
+                  add_size(then_exp->inline_size(), else_exp->inline_size()));
+}
+
+int loop_class::inline_size()
+{
+  return add_size(add_size(1, pred->inline_size()), body->inline_size());
+}
+
+int typcase_class::inline_size()
+{
+  return NO_INLINE;
+}
+
+int block_class::inline_size()
+{
+  return list_inline_size(body);
+}
+
+int let_class::inline_size()
+{
+  return add_size(add_size(1, init->inline_size()), body->inline_size());
+}
+
+int plus_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int sub_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int mul_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int divide_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int neg_class::inline_size()
+{
+  return add_size(1, e1->inline_size());
+}
+
+int lt_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int eq_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int leq_class::inline_size()
+{
+  return add_size(add_size(1, e1->inline_size()), e2->inline_size());
+}
+
+int comp_class::inline_size()
+{
+  return add_size(1, e1->inline_size());
+}
+
+int int_const_class::inline_size()
+{
+  return 1;
+}
+
+int string_const_class::inline_size()
+{
+  return 1;
+}
+
+int bool_const_class::inline_size()
+{
+  return 1;
+}
+
+int new__class::inline_size()
+{
+  return type_name == SELF_TYPE ? NO_INLINE : 1;
+}
+
+int isvoid_class::inline_size()
+{
+  return add_size(1, e1->inline_size());
+}
+
+int no_expr_class::inline_size()
+{
+  return 0;
+}
+
+int object_class::inline_size()
+{
+  return 1;
 }
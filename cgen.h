@@ -1,12 +1,29 @@
 #include <assert.h>
 #include <stdio.h>
+#include <unordered_map>
 #include <vector>
 #include "emit.h"
 #include "cool-tree.h"
 #include "symtab.h"
+#include "ir.h"
 
 
 enum Basicness     {Basic, NotBasic};
+
+// The back end: SPIM, x86-64 (see cgen_x86_64.cc) or C (see cgen_c.cc).
+enum Target        {TARGET_MIPS, TARGET_X86_64, TARGET_C};
+extern Target cgen_target;
+
+// With -O, the size up to which methods are inlined (COOL_INLINE).
+extern int cgen_inline;
+
+class CgenNode;
+
+// Every class by name, the special ones (No_class, SELF_TYPE, prim_slot) included.
+extern std::unordered_map<Symbol, CgenNode *> sym_node;
+
+// Builds the basic classes, once.
+void prepare_basic_classes();
 #define TRUE 1
 #define FALSE 0
 
@@ -35,7 +52,15 @@ private:
    void code_constants();
    void code_dispTab();
    void code_protObj();
-   void code_init();
+   void code_init(CgenNodeP curr, ostream &s);
+   void code_x86_64_data();
+   void code_c_data();
+
+// Optimization passes over the class bodies, run before code().
+
+   void fold_constants();
+   void find_inlinable();
+   void find_trivial_inits();
 
 // The following creates an inheritance graph from
 // a list of classes.  The graph is implemented as
@@ -43,6 +68,7 @@ private:
 // in the base class symbol table.
 
    void install_basic_classes();
+   void install_special_class(CgenNodeP nd);
    void install_class(CgenNodeP nd);
    void install_classes(Classes cs);
    void build_inheritance_tree();
@@ -55,9 +81,10 @@ public:
    CgenNodeP root();
    void code_class_nameTab();
    void code_class_objTab();
+   void code_class_rangeTab();
    int get_class_tag(Symbol given_name);
-   std::vector<CgenNodeP> classes_ordered;
-   void fill_class_tag();
+   std::vector<CgenNodeP> classes_ordered;   // by tag
+   void index_classes();
    CgenNodeP find_class(Symbol class_name);
 };
 
@@ -80,17 +107,64 @@ public:
    CgenNodeP get_parentnd() { return parentnd; }
    int basic() { return (basic_status == Basic); }
 
-   std::vector< std::pair<Symbol, Symbol> > dispatch_table;
-   void fill_dispatch_table();
+   // Set by CgenClassTable::index_classes().
+   int tag;
+   int max_tag;                               // its descendants are tag+1..max_tag
+   int depth;                                 // 0 for Object
+
+   std::vector< std::pair<Symbol, Symbol> > dispatch_table;   // {method, defining class} by slot
+   std::unordered_map<Symbol, int> dispatch_slots;            // method -> slot
+   std::vector<bool> overridden;    // by slot: whether a descendant redefines the method
+   std::unordered_map<Symbol, method_class*> inlinable;      // its methods small enough to inline
+   bool trivial_init;               // new need only copy the prototype (find_trivial_inits)
+   void fill_dispatch_table();                                // once the parent's is filled
 
    std::vector<attr_class*> attr_layout;
    void fill_attr_layout();
-   int varLen;
 
+   SymbolTable<Symbol, std::pair<int, int>> variables; //pair: {type, index} ; type: 0 attr (index in the object), 1 formal, let or case variable (index is its virtual register)
+};
 
-   SymbolTable<Symbol, std::pair<int, int>> variables; //pair: {type, index} ; type: -1 default, 0 attr, 1 method formal, 2 let parameter
+//
+// The state of translating one method or init routine into an
+// IRFunction.  Blocks are laid out in the order they are started.
+//
+class IRBuilder {
+private:
+   int block;                      // the block being filled, -1 if none
+   std::vector<int> layout;
+   std::vector<Symbol> var_of;     // the variable a virtual register holds
+
+public:
+   IRFunction &fn;
+   CgenNodeP curr;
+   CgenClassTableP ct;
+   int depth;                      // loop nesting of new blocks
+   int self;                       // 0, or the receiver of the method being inlined
+   CgenNodeP self_class;           // curr, or the class of the method being inlined
+   int call_line;                  // 0, or the line of the call being inlined
+
+   IRBuilder(IRFunction &f, CgenNodeP c, CgenClassTableP t);
+   int new_block();
+   void set_block(int b);
+   int new_var(Symbol name, IRType t);
+   Symbol var(int v);
+   int bind(Symbol name, int v);
+
+   int emit(const IRInsn &in);     // returns the register it defines
+   int def(IROp op, IRType t, int a = -1, int b = -1);
+   int load_imm(int val);
+   int load_address(const std::string &label);
+   void move(int d, int a);
+   void jump(int target);
+   void branch(int cond, int target, int other);
+   int protect(int v, Expression later);
+   void finish();
 };
 
+void code_x86_64_function(IRFunction &fn, CgenNodeP curr, ostream &s);
+void code_c_function(IRFunction &fn, CgenNodeP curr, ostream &s);
+
 class BoolConst 
 {
  private: 
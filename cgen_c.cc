@@ -0,0 +1,790 @@
+//**************************************************************
+//
+// C back end
+//
+// With COOL_TARGET=c in the environment, cgen emits one C translation
+// unit, runtime included, that any C compiler turns into a native
+// program:
+//
+//    COOL_TARGET=c ./mycoolc prog.cl
+//    cc -O2 -x c -o prog prog.s
+//
+// Every class has a struct with the object header and then its
+// attributes, inherited ones first, so that a pointer to an object
+// can be used as a pointer to the struct of any of its ancestors.
+// Attributes are object pointers, except the value of an Int or a
+// Bool, which is an int32_t, and the characters of a String, which are
+// a char pointer.  Dispatch tables are arrays of function pointers,
+// cast to the method's type where they are called, and every method
+// and init routine is a function taking self and the arguments and
+// returning the result.
+//
+// C names are made of a letter for the kind of thing named and the
+// class and method names, each preceded by its length, so they can't
+// clash with each other or with the runtime:
+//
+//      struct S4Main       the object of class Main
+//      P4Main              its prototype
+//      D4Main              its dispatch table
+//      I4Main              its init routine
+//      M4Main4main         method Main.main
+//
+//**************************************************************
+
+#include <map>
+#include <sstream>
+#include <string>
+#include "cgen.h"
+
+extern int cgen_debug;
+extern Symbol Int, Bool, Str, prim_slot, val, str_field;
+
+static const char *runtime_types = R"(
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* not every program uses every constant, helper and register */
+#ifdef __GNUC__
+#define UNUSED __attribute__((unused))
+#else
+#define UNUSED
+#endif
+
+typedef void (*Method)(void);
+
+typedef struct Object {
+  int tag;
+  int size;                     /* in bytes */
+  const Method *disp;
+} Object;
+
+/* an entry of class_objTab */
+typedef struct ClassObj {
+  Object *proto;
+  Object *(*init)(Object *);
+} ClassObj;
+)";
+
+static const char *runtime_functions = R"(
+static void *cool_malloc(size_t bytes)
+{
+  void *p = malloc(bytes);
+  if (p == NULL) {
+    fputs("Out of memory\n", stderr);
+    exit(1);
+  }
+  return p;
+}
+
+/* objects and strings are bumped off chunks that are never freed */
+#define COOL_HEAP_CHUNK (1 << 20)
+
+static char *cool_heap_ptr, *cool_heap_limit;
+
+static void *cool_alloc(size_t bytes)
+{
+  bytes = (bytes + 7) & ~(size_t)7;
+  if (bytes > (size_t)(cool_heap_limit - cool_heap_ptr)) {
+    size_t chunk = bytes > COOL_HEAP_CHUNK ? bytes : COOL_HEAP_CHUNK;
+    cool_heap_ptr = cool_malloc(chunk);
+    cool_heap_limit = cool_heap_ptr + chunk;
+  }
+  void *p = cool_heap_ptr;
+  cool_heap_ptr += bytes;
+  return p;
+}
+
+static Object *cool_copy(Object *o)
+{
+  Object *c = cool_alloc(o->size);
+  memcpy(c, o, o->size);
+  return c;
+}
+
+/* new, where size is a constant the copy can be unrolled for */
+static UNUSED Object *cool_new(Object *proto, size_t size)
+{
+  Object *c = cool_alloc(size);
+  memcpy(c, proto, size);
+  return c;
+}
+
+static Object *cool_box_int(int32_t val)
+{
+  struct S3Int *i = (struct S3Int *)cool_copy(&P3Int.hdr);
+  i->a__val = val;
+  return &i->hdr;
+}
+
+static int32_t cool_str_len(Object *s)
+{
+  return ((struct S3Int *)((struct S6String *)s)->a__val)->a__val;
+}
+
+static const char *cool_str_chars(Object *s)
+{
+  return ((struct S6String *)s)->a__str_field;
+}
+
+static Object *cool_new_string(const char *chars, size_t len)
+{
+  char *buf = cool_alloc(len + 1);
+  memcpy(buf, chars, len);
+  buf[len] = '\0';
+  struct S6String *s = (struct S6String *)cool_copy(&P6String.hdr);
+  s->a__val = cool_box_int(len);
+  s->a__str_field = buf;
+  return &s->hdr;
+}
+
+static const char *cool_class_name(Object *o)
+{
+  return cool_str_chars(class_nameTab[o->tag]);
+}
+
+static UNUSED Object *cool_new_self(Object *self)
+{
+  const ClassObj *c = &class_objTab[self->tag];
+  return c->init(cool_copy(c->proto));
+}
+
+
+static UNUSED int32_t cool_equal(Object *x, Object *y)
+{
+  if (x == y)
+    return 1;
+  if (x == NULL || y == NULL || x->tag != y->tag)
+    return 0;
+  if (x->tag == cool_int_tag || x->tag == cool_bool_tag)
+    return ((struct S3Int *)x)->a__val == ((struct S3Int *)y)->a__val;
+  if (x->tag == cool_string_tag)
+    return cool_str_len(x) == cool_str_len(y) &&
+           memcmp(cool_str_chars(x), cool_str_chars(y), cool_str_len(x)) == 0;
+  return 0;
+}
+
+static void cool_print_int(int32_t val)
+{
+  printf("%d", (int)val);
+}
+
+static UNUSED _Noreturn void cool_dispatch_abort(Object *filename, int line)
+{
+  printf("%s:%d: Dispatch to void.\n", cool_str_chars(filename), line);
+  exit(0);
+}
+
+static UNUSED _Noreturn void cool_case_abort(Object *o)
+{
+  printf("No match in case statement for Class %s\n", cool_class_name(o));
+  exit(0);
+}
+
+static UNUSED _Noreturn void cool_case_abort2(Object *filename, int line)
+{
+  printf("%s:%d: Match on void in case statement.\n", cool_str_chars(filename), line);
+  exit(0);
+}
+
+static _Noreturn void cool_overflow_abort(Object *filename, int line)
+{
+  printf("%s:%d: Arithmetic overflow.\n", cool_str_chars(filename), line);
+  exit(0);
+}
+
+static _Noreturn void cool_divide_abort(Object *filename, int line)
+{
+  printf("%s:%d: Division by zero.\n", cool_str_chars(filename), line);
+  exit(0);
+}
+
+/* addition and subtraction trap on overflow like MIPS add and sub */
+static UNUSED int32_t cool_add(int32_t x, int32_t y, Object *filename, int line)
+{
+  int64_t d = (int64_t)x + y;
+  if (d < INT32_MIN || d > INT32_MAX)
+    cool_overflow_abort(filename, line);
+  return (int32_t)d;
+}
+
+static UNUSED int32_t cool_sub(int32_t x, int32_t y, Object *filename, int line)
+{
+  int64_t d = (int64_t)x - y;
+  if (d < INT32_MIN || d > INT32_MAX)
+    cool_overflow_abort(filename, line);
+  return (int32_t)d;
+}
+
+/* the most negative Int divided by -1 is itself, as on MIPS */
+static UNUSED int32_t cool_div(int32_t x, int32_t y, Object *filename, int line)
+{
+  if (y == 0)
+    cool_divide_abort(filename, line);
+  return y == -1 ? (int32_t)-(uint32_t)x : x / y;
+}
+
+/* a line of input without its newline; NULL at end of file */
+static char *cool_read_line(size_t *len)
+{
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t n = getline(&line, &cap, stdin);
+  if (n < 0) {
+    free(line);
+    return NULL;
+  }
+  if (n > 0 && line[n - 1] == '\n')
+    line[--n] = '\0';
+  *len = n;
+  return line;
+}
+
+static Object *M6Object5abort(Object *self)
+{
+  printf("Abort called from class %s\n", cool_class_name(self));
+  exit(0);
+}
+
+static Object *M6Object9type_name(Object *self)
+{
+  return class_nameTab[self->tag];
+}
+
+static Object *M6Object4copy(Object *self)
+{
+  return cool_copy(self);
+}
+
+static Object *M2IO10out_string(Object *self, Object *s)
+{
+  fwrite(cool_str_chars(s), 1, cool_str_len(s), stdout);
+  return self;
+}
+
+static Object *M2IO7out_int(Object *self, Object *i)
+{
+  cool_print_int(((struct S3Int *)i)->a__val);
+  return self;
+}
+
+static Object *M2IO9in_string(Object *self)
+{
+  size_t len;
+  char *line = cool_read_line(&len);
+  Object *s;
+  if (line == NULL || strlen(line) != len)
+    s = cool_new_string("", 0);   /* a line holding a NUL reads as "" */
+  else
+    s = cool_new_string(line, len);
+  free(line);
+  return s;
+}
+
+static Object *M2IO6in_int(Object *self)
+{
+  size_t len;
+  char *line = cool_read_line(&len);
+  Object *i = cool_box_int(line ? atoi(line) : 0);
+  free(line);
+  return i;
+}
+
+static Object *M6String6length(Object *self)
+{
+  return ((struct S6String *)self)->a__val;
+}
+
+static Object *M6String6concat(Object *self, Object *s)
+{
+  size_t n = cool_str_len(self), m = cool_str_len(s);
+  char *chars = cool_malloc(n + m + 1);
+  memcpy(chars, cool_str_chars(self), n);
+  memcpy(chars + n, cool_str_chars(s), m);
+  Object *r = cool_new_string(chars, n + m);
+  free(chars);
+  return r;
+}
+
+static Object *M6String6substr(Object *self, Object *i, Object *l)
+{
+  int32_t start = ((struct S3Int *)i)->a__val, len = ((struct S3Int *)l)->a__val;
+  if (start < 0 || len < 0 || (int64_t)start + len > cool_str_len(self)) {
+    printf("Index to substr is out of range\n");
+    exit(0);
+  }
+  return cool_new_string(cool_str_chars(self) + start, len);
+}
+
+int main(void)
+{
+  M4Main4main(I4Main(cool_copy(&P4Main.hdr)));
+  printf("\nCOOL program successfully executed\n");
+  return 0;
+}
+)";
+
+static std::string c_name(char kind, const std::string &class_, const std::string &method = "")
+{
+  std::ostringstream s;
+  s << kind << class_.size() << class_;
+  if (!method.empty())
+    s << method.size() << method;
+  return s.str();
+}
+
+// The function of a label "Class.method".
+static std::string c_method_name(const std::string &label)
+{
+  size_t sep = label.find(METHOD_SEP);
+  return c_name('M', label.substr(0, sep), label.substr(sep + 1));
+}
+
+static std::string c_struct(Symbol class_)
+{
+  return "struct " + c_name('S', class_->get_string());
+}
+
+static std::string c_field(attr_class *attr)
+{
+  return std::string("a_") + attr->name->get_string();
+}
+
+static void code_c_string(ostream &s, const char *str, int len)
+{
+  static const char hex[] = "01234567";
+  s << '"';
+  for (int i = 0; i < len; i++) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\')
+      s << '\\' << c;
+    else if (c >= ' ' && c < 127)
+      s << c;
+    else
+      s << '\\' << hex[c >> 6] << hex[(c >> 3) & 7] << hex[c & 7];
+  }
+  s << '"';
+}
+
+// The parameter list of a method or init routine with nargs arguments.
+static void code_c_params(ostream &s, int nargs)
+{
+  s << "(Object *self";
+  for (int i = 0; i < nargs; i++)
+    s << ", Object *a" << i;
+  s << ")";
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Data
+//
+//////////////////////////////////////////////////////////////////////
+
+void CgenClassTable::code_c_data()
+{
+  std::vector<CgenNodeP> classes_ = classes_ordered;
+
+  str << runtime_types << endl;
+
+  for (CgenNodeP curr : classes_) {
+    curr->fill_attr_layout();
+
+    str << c_struct(curr->name) << " {" << endl
+        << "  Object hdr;" << endl;
+    for (attr_class *attr : curr->attr_layout) {
+      if (attr->type_decl != prim_slot)
+        str << "  Object *";
+      else if (curr->name == Str)
+        str << "  const char *";
+      else
+        str << "  int32_t ";
+      str << c_field(attr) << ";" << endl;
+    }
+    str << "};" << endl << endl;
+  }
+
+  for (CgenNodeP curr : classes_) {
+    str << "static Object *" << c_name('I', curr->name->get_string()) << "(Object *self);" << endl;
+    Features fs = curr->features;
+    for (int i = fs->first(); fs->more(i); i = fs->next(i))
+      if (fs->nth(i)->is_method()) {
+        method_class *method = (method_class *)fs->nth(i);
+        str << "static Object *"
+            << c_name('M', curr->name->get_string(), method->name->get_string());
+        code_c_params(str, method->formals->len());
+        str << ";" << endl;
+      }
+  }
+  str << endl;
+
+  for (CgenNodeP curr : classes_) {
+    str << "static const Method " << c_name('D', curr->name->get_string()) << "[] = {" << endl;
+    for (auto &pair : curr->dispatch_table)
+      str << "  (Method)" << c_name('M', pair.second->get_string(), pair.first->get_string())
+          << "," << endl;
+    str << "};" << endl;
+  }
+  str << endl;
+
+  // constants; the lengths of the strings are Int constants too
+  stringtable.add_string("");
+  inttable.add_string("0");
+  for (int i = stringtable.first(); stringtable.more(i); i = stringtable.next(i))
+    inttable.add_int(stringtable.lookup(i)->get_len());
+
+  for (int i = inttable.first(); inttable.more(i); i = inttable.next(i)) {
+    IntEntry *entry = inttable.lookup(i);
+    str << "static UNUSED " << c_struct(Int) << " ";
+    entry->code_ref(str);
+    str << " = {{" << intclasstag << ", sizeof(" << c_struct(Int) << "), "
+        << c_name('D', Int->get_string()) << "}, " << entry->get_string() << "};" << endl;
+  }
+  for (int val = 0; val < 2; val++) {
+    str << "static UNUSED " << c_struct(Bool) << " ";
+    BoolConst(val).code_ref(str);
+    str << " = {{" << boolclasstag << ", sizeof(" << c_struct(Bool) << "), "
+        << c_name('D', Bool->get_string()) << "}, " << val << "};" << endl;
+  }
+  for (int i = stringtable.first(); stringtable.more(i); i = stringtable.next(i)) {
+    StringEntry *entry = stringtable.lookup(i);
+    str << "static UNUSED " << c_struct(Str) << " ";
+    entry->code_ref(str);
+    str << " = {{" << stringclasstag << ", sizeof(" << c_struct(Str) << "), "
+        << c_name('D', Str->get_string()) << "}, &";
+    inttable.add_int(entry->get_len())->code_ref(str);
+    str << ".hdr, ";
+    code_c_string(str, entry->get_string(), entry->get_len());
+    str << "};" << endl;
+  }
+  str << endl;
+
+  for (CgenNodeP curr : classes_) {
+    str << "static " << c_struct(curr->name) << " " << c_name('P', curr->name->get_string())
+        << " = {{" << curr->tag << ", sizeof(" << c_struct(curr->name) << "), "
+        << c_name('D', curr->name->get_string()) << "}";
+    for (attr_class *attr : curr->attr_layout) {
+      str << ", ";
+      if (attr->type_decl == Int) {
+        str << "&";
+        inttable.lookup_string("0")->code_ref(str);
+        str << ".hdr";
+      } else if (attr->type_decl == Str) {
+        str << "&";
+        stringtable.lookup_string("")->code_ref(str);
+        str << ".hdr";
+      } else if (attr->type_decl == Bool) {
+        str << "&";
+        BoolConst(0).code_ref(str);
+        str << ".hdr";
+      } else if (attr->type_decl == prim_slot && curr->name == Str) {
+        str << "\"\"";
+      } else {
+        str << "0";
+      }
+    }
+    str << "};" << endl;
+  }
+  str << endl;
+
+  str << "static Object *const " << CLASSNAMETAB << "[] = {" << endl;
+  for (CgenNodeP curr : classes_) {
+    str << "  &";
+    stringtable.lookup_string(curr->name->get_string())->code_ref(str);
+    str << ".hdr," << endl;
+  }
+  str << "};" << endl;
+  str << "static const ClassObj " << CLASSOBJTAB << "[] = {" << endl;
+  for (CgenNodeP curr : classes_)
+    str << "  {&" << c_name('P', curr->name->get_string()) << ".hdr, "
+        << c_name('I', curr->name->get_string()) << "}," << endl;
+  str << "};" << endl;
+  str << "const int " << CLASSRANGETAB << "[] = {";
+  for (CgenNodeP curr : classes_)
+    str << curr->max_tag << ",";
+  str << "};" << endl << endl;
+
+  str << "static const int cool_int_tag = " << intclasstag
+      << ", cool_bool_tag = " << boolclasstag
+      << ", cool_string_tag = " << stringclasstag << ";" << endl;
+  str << runtime_functions << endl;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Lowering of an IRFunction
+//
+// Each virtual register is a local variable, an Object * or an
+// int32_t, and each block a label; the C compiler allocates the
+// registers.  Addition, subtraction and negation abort on overflow,
+// as the trapping MIPS instructions do; multiplication wraps around,
+// as MIPS mul does, and is done on unsigned words so that it is not
+// undefined.
+//
+//////////////////////////////////////////////////////////////////////
+
+class CLowering
+{
+private:
+  IRFunction &fn;
+  CgenNodeP curr;
+  StringEntry *filename;          // for run-time errors
+  std::vector<bool> referenced;   // whether a block's label is used
+  int block;                      // the block being lowered
+
+  std::string reg(int v);
+  std::string attr(const IRInsn &in);
+  void code_jump(int target, ostream &s);
+  void code_void_check(int v, int line, ostream &s);
+  void code_call(const IRInsn &in, ostream &s);
+  void code_insn(const IRInsn &in, ostream &s);
+
+public:
+  CLowering(IRFunction &f, CgenNodeP c);
+  void code(ostream &s);
+};
+
+CLowering::CLowering(IRFunction &f, CgenNodeP c) : fn(f), curr(c), block(0)
+{
+  filename = stringtable.lookup_string(curr->get_filename()->get_string());
+  referenced.assign(fn.blocks.size(), false);
+}
+
+std::string CLowering::reg(int v)
+{
+  return v == 0 ? "self" : "v" + std::to_string(v);
+}
+
+// The attribute an IR_LOAD or IR_STORE reads or writes.
+std::string CLowering::attr(const IRInsn &in)
+{
+  CgenNodeP c = curr;
+  if (!in.label.empty())
+    c = sym_node.at(idtable.lookup_string((char *)in.label.c_str()));
+  return "((" + c_struct(c->name) + " *)" + reg(in.a) + ")->" +
+         c_field(c->attr_layout[in.imm - DEFAULT_OBJFIELDS]);
+}
+
+void CLowering::code_jump(int target, ostream &s)
+{
+  if (target != block + 1) {
+    s << "  goto B" << target << ";" << endl;
+    referenced[target] = true;
+  }
+}
+
+void CLowering::code_void_check(int v, int line, ostream &s)
+{
+  s << "  if (" << reg(v) << " == NULL)" << endl
+    << "    cool_dispatch_abort(&";
+  filename->code_ref(s);
+  s << ".hdr, " << line << ");" << endl;
+}
+
+void CLowering::code_call(const IRInsn &in, ostream &s)
+{
+  if (in.a != 0)
+    code_void_check(in.a, in.line, s);
+  // the C compiler makes a tail call a jump
+  if (in.tail)
+    s << "  return ";
+  else
+    s << "  " << reg(in.d) << " = ";
+  if (in.op == IR_STATIC_DISPATCH) {
+    s << c_method_name(in.label);
+  } else {
+    s << "((Object *(*)";
+    std::ostringstream params;
+    params << "(Object *";
+    for (size_t k = 0; k < in.args.size(); k++)
+      params << ", Object *";
+    params << ")";
+    s << params.str() << ")" << reg(in.a) << "->disp[" << in.imm << "])";
+  }
+  s << "(" << reg(in.a);
+  for (int arg : in.args)
+    s << ", " << reg(arg);
+  s << ");" << endl;
+}
+
+void CLowering::code_insn(const IRInsn &in, ostream &s)
+{
+  std::string d = in.d >= 0 ? reg(in.d) : "", a = in.a >= 0 ? reg(in.a) : "",
+              b = in.b >= 0 ? reg(in.b) : "";
+
+  switch (in.op) {
+  case IR_LI:
+    s << "  " << d << " = " << in.imm << ";" << endl;
+    break;
+  case IR_LA:
+    s << "  " << d << " = &" << in.label << ".hdr;" << endl;
+    break;
+  case IR_MOVE:
+    s << "  " << d << " = " << a << ";" << endl;
+    break;
+  case IR_ARG:
+    s << "  " << d << " = a" << in.imm << ";" << endl;
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_DIV:
+    s << "  " << d << " = "
+      << (in.op == IR_ADD ? "cool_add(" : in.op == IR_SUB ? "cool_sub(" : "cool_div(")
+      << a << ", " << b << ", &";
+    filename->code_ref(s);
+    s << ".hdr, " << in.line << ");" << endl;
+    break;
+  case IR_MUL:
+    s << "  " << d << " = (int32_t)((uint32_t)" << a << " * (uint32_t)" << b << ");" << endl;
+    break;
+  case IR_LT:
+  case IR_LE:
+  case IR_EQ:
+    s << "  " << d << " = " << a
+      << (in.op == IR_LT ? " < " : in.op == IR_LE ? " <= " : " == ") << b << ";" << endl;
+    break;
+  case IR_NEG:
+    s << "  " << d << " = cool_sub(0, " << a << ", &";
+    filename->code_ref(s);
+    s << ".hdr, " << in.line << ");" << endl;
+    break;
+  case IR_NOT:
+    s << "  " << d << " = " << a << " ^ 1;" << endl;
+    break;
+  case IR_ISVOID:
+    s << "  " << d << " = " << a << " == NULL;" << endl;
+    break;
+  case IR_LOAD:
+    if (in.imm == TAG_OFFSET)
+      s << "  " << d << " = " << a << "->tag;" << endl;
+    else
+      s << "  " << d << " = " << attr(in) << ";" << endl;
+    break;
+  case IR_UNBOX:
+    // Int and Bool have the same layout
+    s << "  " << d << " = ((" << c_struct(Int) << " *)" << a << ")->"
+      << "a_" << val->get_string() << ";" << endl;
+    break;
+  case IR_STORE:
+    s << "  " << attr(in) << " = " << b << ";" << endl;
+    break;
+  case IR_BOX_INT:
+    s << "  " << d << " = cool_box_int(" << a << ");" << endl;
+    break;
+  case IR_BOX_BOOL:
+    s << "  " << d << " = " << a << " ? &";
+    BoolConst(1).code_ref(s);
+    s << ".hdr : &";
+    BoolConst(0).code_ref(s);
+    s << ".hdr;" << endl;
+    break;
+  case IR_NEW:
+    s << "  " << d << " = " << c_name('I', in.label) << "(cool_new(&"
+      << c_name('P', in.label) << ".hdr, sizeof(" << c_name('P', in.label) << ")));" << endl;
+    break;
+  case IR_NEW_PROTO:
+    s << "  " << d << " = cool_new(&" << c_name('P', in.label) << ".hdr, sizeof("
+      << c_name('P', in.label) << "));" << endl;
+    break;
+  case IR_NEW_SELF:
+    s << "  " << d << " = cool_new_self(self);" << endl;
+    break;
+  case IR_DISPATCH:
+  case IR_STATIC_DISPATCH:
+    code_call(in, s);
+    break;
+  case IR_OBJ_EQ:
+    s << "  " << d << " = cool_equal(" << a << ", " << b << ");" << endl;
+    break;
+  case IR_INIT:
+    s << "  " << c_name('I', in.label) << "(" << a << ");" << endl;
+    break;
+  case IR_PRINT_INT:
+    if (in.b != 0)
+      code_void_check(in.b, in.line, s);
+    s << "  cool_print_int(" << a << ");" << endl;
+    break;
+  case IR_CHECK_VOID:
+    code_void_check(in.a, in.line, s);
+    break;
+  case IR_JUMP:
+    code_jump(in.target, s);
+    break;
+  case IR_BRANCH:
+    if (in.target == block + 1) {
+      s << "  if (!" << a << ")" << endl
+        << "  ";
+      code_jump(in.other, s);
+    } else {
+      s << "  if (" << a << ")" << endl
+        << "  ";
+      code_jump(in.target, s);
+      code_jump(in.other, s);
+    }
+    break;
+  case IR_SWITCH:
+    // every case jumps, even to the next block
+    s << "  switch (" << a << ") {" << endl;
+    for (size_t i = 0; i < in.table.size(); i++) {
+      s << "  case " << in.imm + i << ": goto B" << in.table[i] << ";" << endl;
+      referenced[in.table[i]] = true;
+    }
+    s << "  default: goto B" << in.other << ";" << endl
+      << "  }" << endl;
+    referenced[in.other] = true;
+    break;
+  case IR_RETURN:
+    s << "  return " << a << ";" << endl;
+    break;
+  case IR_ABORT_CASE_VOID:
+    s << "  cool_case_abort2(&";
+    filename->code_ref(s);
+    s << ".hdr, " << in.line << ");" << endl;
+    break;
+  case IR_ABORT_CASE:
+    s << "  cool_case_abort(" << a << ");" << endl;
+    break;
+  }
+}
+
+void CLowering::code(ostream &s)
+{
+  if (cgen_debug)
+    fn.print(s, "// ");
+
+  // a method is named "Class.method", an init routine "Class_init"
+  if (fn.name.find(METHOD_SEP) != std::string::npos)
+    s << "static Object *" << c_method_name(fn.name);
+  else
+    s << "static Object *" << c_name('I', curr->name->get_string());
+  code_c_params(s, fn.nargs);
+  s << endl << "{" << endl;
+  for (size_t v = 1; v < fn.vregs.size(); v++)
+    s << "  " << (fn.vregs[v] == IR_WORD ? "int32_t " : "Object *") << reg(v) << " UNUSED;" << endl;
+
+  std::vector<std::string> text(fn.blocks.size());
+  for (block = 0; block < int(fn.blocks.size()); block++) {
+    std::ostringstream bs;
+    for (const IRInsn &in : fn.blocks[block].insns) {
+      code_insn(in, bs);
+      // a tail call has returned for the function
+      if (in.tail)
+        break;
+    }
+    text[block] = bs.str();
+  }
+
+  for (size_t b = 0; b < text.size(); b++) {
+    if (referenced[b])
+      s << "B" << b << ":" << endl;
+    s << text[b];
+  }
+  s << "}" << endl << endl;
+}
+
+void code_c_function(IRFunction &fn, CgenNodeP curr, ostream &s)
+{
+  CLowering(fn, curr).code(s);
+}
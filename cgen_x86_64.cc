@@ -0,0 +1,866 @@
+//**************************************************************
+//
+// x86-64 back end
+//
+// With COOL_TARGET=x86_64 in the environment, cgen emits GNU assembler
+// source for x86-64 Linux instead of SPIM code.  It is linked with the
+// runtime in runtime_x86_64.c into a native executable:
+//
+//    COOL_TARGET=x86_64 ./mycoolc prog.cl
+//    gcc -o prog prog.s runtime_x86_64.c
+//
+// Objects are laid out as on MIPS with 8-byte words: tag, size in
+// words, dispatch table, then the attributes.  Int and Bool keep
+// their value in the low half of their attribute word; a String has
+// its length (an Int) and then its characters.  class_nameTab and
+// class_objTab are indexed by tag as on MIPS.
+//
+// Methods are called with the receiver in %rax and the arguments on
+// the stack, the first one deepest; the callee pops them and returns
+// its result in %rax.  Self is kept in %rbx.  The frame is
+//
+//      %rbp + 8(n+1)   first argument
+//      ...
+//      %rbp + 16       last argument
+//      %rbp + 8        return address
+//      %rbp            saved %rbp
+//      %rbp - 8        saved %rbx
+//      %rbp - 16       saved %r12
+//      ...
+//                      slot 0
+//      ...
+//
+// Values live in %rcx, %rsi, %rdi, %r8 and %r9, which calls don't
+// preserve, or in the callee-saved %r12-%r15, or in a slot; %rax,
+// %rdx, %r10 and %r11 are scratch.  Runtime routines follow the same
+// convention as methods (see runtime_x86_64.c), except that
+// equality_test takes its operands in %r10 and %r11, the abort
+// routines take theirs in %rdi and %rsi, and _out_int, which prints
+// %rax, preserves every other register.
+//
+//**************************************************************
+
+#include <map>
+#include <sstream>
+#include <string>
+#include "cgen.h"
+
+extern void emit_string_constant(ostream &str, char *s);
+extern int cgen_debug;
+extern int disable_reg_alloc;
+extern thread_local int label_index;
+extern void emit_label_ref(int l, ostream &s);
+extern Symbol Int, Bool, Str;
+
+#define QUAD "\t.quad\t"
+
+struct X86Reg
+{
+  const char *q, *d, *b;        // the 64-, 32- and 8-bit names
+};
+
+static const X86Reg RAX = {"%rax", "%eax", "%al"};
+static const X86Reg RBX = {"%rbx", "%ebx", "%bl"};
+static const X86Reg R10 = {"%r10", "%r10d", "%r10b"};
+static const X86Reg R11 = {"%r11", "%r11d", "%r11b"};
+
+#define NUM_X86_CALLER_REGS 5
+#define NUM_X86_CALLEE_REGS 4
+
+static const X86Reg caller_regs[NUM_X86_CALLER_REGS] = {
+  {"%rcx", "%ecx", "%cl"}, {"%rsi", "%esi", "%sil"}, {"%rdi", "%edi", "%dil"},
+  {"%r8", "%r8d", "%r8b"}, {"%r9", "%r9d", "%r9b"}};
+static const X86Reg callee_regs[NUM_X86_CALLEE_REGS] = {
+  {"%r12", "%r12d", "%r12b"}, {"%r13", "%r13d", "%r13b"},
+  {"%r14", "%r14d", "%r14b"}, {"%r15", "%r15d", "%r15b"}};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Data
+//
+//////////////////////////////////////////////////////////////////////
+
+void CgenClassTable::code_x86_64_data()
+{
+  std::vector<CgenNodeP> classes_ = classes_ordered;
+
+  str << "\t.section\t.note.GNU-stack,\"\",@progbits" << endl
+      << "\t.data" << endl << "\t.balign\t8" << endl;
+  str << GLOBAL << CLASSNAMETAB << endl
+      << GLOBAL << CLASSOBJTAB << endl
+      << GLOBAL << CLASSRANGETAB << endl
+      << GLOBAL << "Main" << PROTOBJ_SUFFIX << endl
+      << GLOBAL << "Int" << PROTOBJ_SUFFIX << endl
+      << GLOBAL << "String" << PROTOBJ_SUFFIX << endl
+      << GLOBAL << INTTAG << endl
+      << GLOBAL << BOOLTAG << endl
+      << GLOBAL << STRINGTAG << endl;
+  str << INTTAG << LABEL << QUAD << intclasstag << endl
+      << BOOLTAG << LABEL << QUAD << boolclasstag << endl
+      << STRINGTAG << LABEL << QUAD << stringclasstag << endl;
+
+  // constants; the lengths of the strings are Int constants too
+  stringtable.add_string("");
+  inttable.add_string("0");
+  for (int i = stringtable.first(); stringtable.more(i); i = stringtable.next(i))
+    inttable.add_int(stringtable.lookup(i)->get_len());
+
+  for (int i = stringtable.first(); stringtable.more(i); i = stringtable.next(i)) {
+    StringEntry *entry = stringtable.lookup(i);
+    int len = entry->get_len();
+    str << QUAD << "-1" << endl;
+    entry->code_ref(str);
+    str << LABEL
+        << QUAD << stringclasstag << endl
+        << QUAD << (DEFAULT_OBJFIELDS + STRING_SLOTS + (len + 8) / 8) << endl
+        << QUAD << Str << DISPTAB_SUFFIX << endl
+        << QUAD;
+    inttable.add_int(len)->code_ref(str);
+    str << endl;
+    emit_string_constant(str, entry->get_string());
+    str << "\t.balign\t8" << endl;
+  }
+  for (int i = inttable.first(); inttable.more(i); i = inttable.next(i)) {
+    IntEntry *entry = inttable.lookup(i);
+    str << QUAD << "-1" << endl;
+    entry->code_ref(str);
+    str << LABEL
+        << QUAD << intclasstag << endl
+        << QUAD << (DEFAULT_OBJFIELDS + INT_SLOTS) << endl
+        << QUAD << Int << DISPTAB_SUFFIX << endl
+        << QUAD << entry->get_string() << endl;
+  }
+  for (int val = 0; val < 2; val++) {
+    str << QUAD << "-1" << endl;
+    BoolConst(val).code_ref(str);
+    str << LABEL
+        << QUAD << boolclasstag << endl
+        << QUAD << (DEFAULT_OBJFIELDS + BOOL_SLOTS) << endl
+        << QUAD << Bool << DISPTAB_SUFFIX << endl
+        << QUAD << val << endl;
+  }
+
+  str << CLASSNAMETAB << LABEL;
+  for (CgenNodeP curr : classes_) {
+    str << QUAD;
+    stringtable.lookup_string(curr->name->get_string())->code_ref(str);
+    str << endl;
+  }
+  str << CLASSOBJTAB << LABEL;
+  for (CgenNodeP curr : classes_)
+    str << QUAD << curr->name << PROTOBJ_SUFFIX << endl
+        << QUAD << curr->name << CLASSINIT_SUFFIX << endl;
+  str << CLASSRANGETAB << LABEL;
+  for (CgenNodeP curr : classes_)
+    str << QUAD << curr->max_tag << endl;
+
+  for (CgenNodeP curr : classes_) {
+    str << curr->name << DISPTAB_SUFFIX << LABEL;
+    for (auto &pair : curr->dispatch_table)
+      str << QUAD << pair.second << METHOD_SEP << pair.first << endl;
+  }
+
+  for (CgenNodeP curr : classes_) {
+    curr->fill_attr_layout();
+    str << QUAD << "-1" << endl
+        << curr->name << PROTOBJ_SUFFIX << LABEL
+        << QUAD << curr->tag << endl
+        << QUAD << (DEFAULT_OBJFIELDS + curr->attr_layout.size()) << endl
+        << QUAD << curr->name << DISPTAB_SUFFIX << endl;
+    for (attr_class *attr : curr->attr_layout) {
+      str << QUAD;
+      if (attr->type_decl == Int)
+        inttable.lookup_string("0")->code_ref(str);
+      else if (attr->type_decl == Str)
+        stringtable.lookup_string("")->code_ref(str);
+      else if (attr->type_decl == Bool)
+        BoolConst(0).code_ref(str);
+      else
+        str << 0;
+      str << endl;
+    }
+  }
+
+  str << "\t.text" << endl
+      << GLOBAL << "Main" << CLASSINIT_SUFFIX << endl
+      << GLOBAL << "Main" << METHOD_SEP << "main" << endl;
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Lowering of an IRFunction
+//
+// As on MIPS, operands without a register are loaded into a scratch
+// register first, a comparison used only by the branch that follows
+// it is folded into the branch, and a jump to the next block falls
+// through.  Words are 32 bits and are operated on with the 32-bit
+// instructions, which clear the upper half of their destination.
+//
+//////////////////////////////////////////////////////////////////////
+
+class X86Lowering
+{
+private:
+  IRFunction &fn;
+  IRAlloc alloc;
+  StringEntry *filename;          // for run-time errors
+  std::vector<int> labels;        // of each block
+  std::vector<bool> referenced;   // whether a block's label is used
+  int block;                      // the block being lowered
+  std::ostringstream tables;      // the jump tables of switches
+  std::ostringstream traps;       // calls of the arithmetic error routines
+
+  int home_offset(int v);
+  bool const_imm(int v, int &imm);
+  const X86Reg *use(int v, const X86Reg *scratch, ostream &s);
+  const X86Reg *target(int v, const X86Reg *scratch);
+  void define(int v, const X86Reg *reg, ostream &s);
+  void label_ref(int b, ostream &s);
+
+  void code_prologue(ostream &s);
+  void code_epilogue(ostream &s);
+  void code_void_check(const X86Reg *reg, int line, ostream &s);
+  void code_trap(const char *cond, const char *routine, int line, ostream &s);
+  void code_call(const IRInsn &in, ostream &s);
+  bool args_in_place(const IRInsn &in);
+  void code_tail_call(const IRInsn &in, bool in_place, ostream &s);
+  void code_new(const IRInsn &in, ostream &s);
+  void code_compare(const IRInsn &cmp, ostream &s);
+  void code_cond(const IRInsn *cmp, int cond, bool negate, int b, ostream &s);
+  void code_branch(const IRInsn *cmp, const IRInsn &br, ostream &s);
+  void code_switch(const IRInsn &in, ostream &s);
+  void code_insn(const IRInsn &in, ostream &s);
+
+public:
+  X86Lowering(IRFunction &f, CgenNodeP curr);
+  void code(ostream &s);
+};
+
+X86Lowering::X86Lowering(IRFunction &f, CgenNodeP curr) : fn(f), block(0)
+{
+  allocate_registers(fn, disable_reg_alloc ? 0 : NUM_X86_CALLER_REGS,
+                     disable_reg_alloc ? 0 : NUM_X86_CALLEE_REGS, true, alloc);
+  filename = stringtable.lookup_string(curr->get_filename()->get_string());
+  for (size_t b = 0; b < fn.blocks.size(); b++)
+    labels.push_back(label_index++);
+  referenced.assign(fn.blocks.size(), false);
+}
+
+// Offset from %rbp, in bytes, of a value kept in a slot or argument.
+int X86Lowering::home_offset(int v)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_ARG)
+    return 8 * (fn.nargs - h.index + 1);
+  return -8 * (2 + alloc.callee_used + h.index);
+}
+
+bool X86Lowering::const_imm(int v, int &imm)
+{
+  if (alloc.homes[v].kind != HOME_CONST || alloc.const_def[v]->op != IR_LI)
+    return false;
+  imm = alloc.const_def[v]->imm;
+  return true;
+}
+
+// The register holding v, loading it into scratch if it has none.
+const X86Reg *X86Lowering::use(int v, const X86Reg *scratch, ostream &s)
+{
+  const IRHome &h = alloc.homes[v];
+  switch (h.kind) {
+  case HOME_SELF:
+    return &RBX;
+  case HOME_CALLER:
+    return &caller_regs[h.index];
+  case HOME_CALLEE:
+    return &callee_regs[h.index];
+  case HOME_CONST: {
+    const IRInsn *c = alloc.const_def[v];
+    if (c->op == IR_LA)
+      s << "\tleaq\t" << c->label << "(%rip), " << scratch->q << endl;
+    else
+      s << "\tmovl\t$" << c->imm << ", " << scratch->d << endl;
+    return scratch;
+  }
+  default:
+    s << "\tmovq\t" << home_offset(v) << "(%rbp), " << scratch->q << endl;
+    return scratch;
+  }
+}
+
+// The register to compute v into: its own, or scratch.
+const X86Reg *X86Lowering::target(int v, const X86Reg *scratch)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_CALLER)
+    return &caller_regs[h.index];
+  if (h.kind == HOME_CALLEE)
+    return &callee_regs[h.index];
+  return scratch;
+}
+
+// v has been computed into reg; put it in its home.
+void X86Lowering::define(int v, const X86Reg *reg, ostream &s)
+{
+  const IRHome &h = alloc.homes[v];
+  if (h.kind == HOME_SLOT || h.kind == HOME_ARG)
+    s << "\tmovq\t" << reg->q << ", " << home_offset(v) << "(%rbp)" << endl;
+  else if (h.kind == HOME_CALLER || h.kind == HOME_CALLEE) {
+    const X86Reg *home = target(v, reg);
+    if (home != reg)
+      s << "\tmovq\t" << reg->q << ", " << home->q << endl;
+  }
+}
+
+void X86Lowering::label_ref(int b, ostream &s)
+{
+  emit_label_ref(labels[b], s);
+  referenced[b] = true;
+}
+
+void X86Lowering::code_prologue(ostream &s)
+{
+  s << "\tpushq\t%rbp" << endl
+    << "\tmovq\t%rsp, %rbp" << endl
+    << "\tpushq\t%rbx" << endl;
+  for (int i = 0; i < alloc.callee_used; i++)
+    s << "\tpushq\t" << callee_regs[i].q << endl;
+  if (alloc.slots > 0)
+    s << "\tsubq\t$" << 8 * alloc.slots << ", %rsp" << endl;
+  s << "\tmovq\t%rax, %rbx" << endl;
+}
+
+void X86Lowering::code_epilogue(ostream &s)
+{
+  for (int i = 0; i < alloc.callee_used; i++)
+    s << "\tmovq\t" << -8 * (2 + i) << "(%rbp), " << callee_regs[i].q << endl;
+  s << "\tmovq\t-8(%rbp), %rbx" << endl
+    << "\tleave" << endl;
+  if (fn.nargs > 0)
+    s << "\tret\t$" << 8 * fn.nargs << endl;
+  else
+    s << "\tret" << endl;
+}
+
+// Abort with the file name and line if the object in reg is void.
+void X86Lowering::code_void_check(const X86Reg *reg, int line, ostream &s)
+{
+  int ok = label_index++;
+  s << "\ttestq\t" << reg->q << ", " << reg->q << endl
+    << "\tjne\t";
+  emit_label_ref(ok, s);
+  s << endl
+    << "\tleaq\t";
+  filename->code_ref(s);
+  s << "(%rip), %rdi" << endl
+    << "\tmovl\t$" << line << ", %esi" << endl
+    << "\tcall\t_dispatch_abort" << endl;
+  emit_label_ref(ok, s);
+  s << LABEL;
+}
+
+// Jump if cond to a call of the error routine, with the file name and
+// line, that is put out of the way after the function's blocks.
+void X86Lowering::code_trap(const char *cond, const char *routine, int line, ostream &s)
+{
+  int trap = label_index++;
+  s << "\tj" << cond << "\t";
+  emit_label_ref(trap, s);
+  s << endl;
+  emit_label_ref(trap, traps);
+  traps << LABEL
+        << "\tleaq\t";
+  filename->code_ref(traps);
+  traps << "(%rip), %rdi" << endl
+        << "\tmovl\t$" << line << ", %esi" << endl
+        << "\tcall\t" << routine << endl;
+}
+
+void X86Lowering::code_call(const IRInsn &in, ostream &s)
+{
+  int n = in.args.size();
+  bool in_place = args_in_place(in);
+  if (in_place) {
+    for (int k = 0; k < n; k++) {
+      const X86Reg *arg = use(in.args[k], &R11, s);
+      s << "\tmovq\t" << arg->q << ", " << 8 * (fn.nargs + 1 - k) << "(%rbp)" << endl;
+    }
+  } else if (n > 0) {
+    s << "\tsubq\t$" << 8 * n << ", %rsp" << endl;
+    for (int k = 0; k < n; k++) {
+      const X86Reg *arg = use(in.args[k], &R11, s);
+      s << "\tmovq\t" << arg->q << ", " << 8 * (n - 1 - k) << "(%rsp)" << endl;
+    }
+  }
+  const X86Reg *receiver = use(in.a, &RAX, s);
+  if (in.a != 0)
+    code_void_check(receiver, in.line, s);
+  if (receiver != &RAX)
+    s << "\tmovq\t" << receiver->q << ", %rax" << endl;
+  if (in.tail) {
+    code_tail_call(in, in_place, s);
+    return;
+  }
+  if (in.op == IR_STATIC_DISPATCH) {
+    s << "\tcall\t" << in.label << endl;
+  } else {
+    s << "\tmovq\t" << 8 * DISPTABLE_OFFSET << "(%rax), %r11" << endl
+      << "\tcall\t*" << 8 * in.imm << "(%r11)" << endl;
+  }
+  define(in.d, &RAX, s);
+}
+
+// As on MIPS, whether a tail call can store its arguments over the caller's.
+bool X86Lowering::args_in_place(const IRInsn &in)
+{
+  if (!in.tail || int(in.args.size()) > fn.nargs || alloc.homes[in.a].kind == HOME_ARG)
+    return false;
+  for (int arg : in.args)
+    if (alloc.homes[arg].kind == HOME_ARG)
+      return false;
+  return true;
+}
+
+//
+// As on MIPS, a tail call restores the saved registers, moves the
+// arguments up to end where the caller's began, and jumps to the
+// callee with the caller's return address below them.  The caller's
+// %rbp is kept in %rcx meanwhile; nothing is live in it by now.
+//
+void X86Lowering::code_tail_call(const IRInsn &in, bool in_place, ostream &s)
+{
+  int n = in.args.size();
+  if (in.op == IR_DISPATCH)
+    s << "\tmovq\t" << 8 * DISPTABLE_OFFSET << "(%rax), %r11" << endl
+      << "\tmovq\t" << 8 * in.imm << "(%r11), %r11" << endl;
+  for (int i = 0; i < alloc.callee_used; i++)
+    s << "\tmovq\t" << -8 * (2 + i) << "(%rbp), " << callee_regs[i].q << endl;
+  s << "\tmovq\t-8(%rbp), %rbx" << endl
+    << "\tmovq\t8(%rbp), %r10" << endl
+    << "\tmovq\t(%rbp), %rcx" << endl;
+  for (int k = 0; k < n && !in_place; k++)
+    s << "\tmovq\t" << 8 * (n - 1 - k) << "(%rsp), %rdx" << endl
+      << "\tmovq\t%rdx, " << 8 * (fn.nargs + 1 - k) << "(%rbp)" << endl;
+  s << "\tleaq\t" << 8 * (fn.nargs + 1 - n) << "(%rbp), %rsp" << endl
+    << "\tmovq\t%r10, (%rsp)" << endl
+    << "\tmovq\t%rcx, %rbp" << endl;
+  if (in.op == IR_STATIC_DISPATCH)
+    s << "\tjmp\t" << in.label << endl;
+  else
+    s << "\tjmp\t*%r11" << endl;
+}
+
+//
+// As on MIPS, an object is allocated by bumping the runtime's heap
+// pointer and copying the prototype in, and only when the heap's
+// current chunk is used up by Object.copy.
+//
+void X86Lowering::code_new(const IRInsn &in, ostream &s)
+{
+  std::string proto = in.label + PROTOBJ_SUFFIX;
+  int slow = -1, done = -1;
+  if (in.imm <= MAX_INLINE_NEW) {
+    slow = label_index++;
+    done = label_index++;
+    s << "\tmovq\tcool_heap_ptr(%rip), %rax" << endl
+      << "\tleaq\t" << 8 * in.imm << "(%rax), %r10" << endl
+      << "\tcmpq\tcool_heap_limit(%rip), %r10" << endl
+      << "\tja\t";
+    emit_label_ref(slow, s);
+    s << endl
+      << "\tmovq\t%r10, cool_heap_ptr(%rip)" << endl
+      << "\tleaq\t" << proto << "(%rip), %r11" << endl;
+    for (int k = 0; k < in.imm; k++)
+      s << "\tmovq\t" << 8 * k << "(%r11), %rdx" << endl
+        << "\tmovq\t%rdx, " << 8 * k << "(%rax)" << endl;
+    s << "\tjmp\t";
+    emit_label_ref(done, s);
+    s << endl;
+    emit_label_ref(slow, s);
+    s << LABEL;
+  }
+  s << "\tleaq\t" << proto << "(%rip), %rax" << endl
+    << "\tcall\tObject.copy" << endl;
+  if (done >= 0) {
+    emit_label_ref(done, s);
+    s << LABEL;
+  }
+  if (in.op == IR_NEW)
+    s << "\tcall\t" << in.label << CLASSINIT_SUFFIX << endl;
+}
+
+// Set the flags for a comparison of two words.
+void X86Lowering::code_compare(const IRInsn &cmp, ostream &s)
+{
+  const X86Reg *x = use(cmp.a, &R10, s);
+  int imm;
+  if (const_imm(cmp.b, imm))
+    s << "\tcmpl\t$" << imm << ", " << x->d << endl;
+  else {
+    const X86Reg *y = use(cmp.b, &R11, s);
+    s << "\tcmpl\t" << y->d << ", " << x->d << endl;
+  }
+}
+
+//
+// Branch to block b if the condition holds, or if it doesn't when
+// negate is set.  The condition is either the word cond or, folded
+// into the branch, the comparison cmp.
+//
+void X86Lowering::code_cond(const IRInsn *cmp, int cond, bool negate, int b, ostream &s)
+{
+  const char *op;
+  if (cmp == NULL || cmp->op == IR_ISVOID || cmp->op == IR_NOT) {
+    // isvoid and not hold when their operand is 0
+    const X86Reg *x = use(cmp ? cmp->a : cond, &R10, s);
+    if (cmp && cmp->op == IR_ISVOID)
+      s << "\ttestq\t" << x->q << ", " << x->q << endl;
+    else
+      s << "\ttestl\t" << x->d << ", " << x->d << endl;
+    op = ((cmp != NULL) != negate) ? "je" : "jne";
+  } else {
+    code_compare(*cmp, s);
+    if (cmp->op == IR_LT)
+      op = negate ? "jge" : "jl";
+    else if (cmp->op == IR_LE)
+      op = negate ? "jg" : "jle";
+    else
+      op = negate ? "jne" : "je";
+  }
+  s << "\t" << op << "\t";
+  label_ref(b, s);
+  s << endl;
+}
+
+void X86Lowering::code_branch(const IRInsn *cmp, const IRInsn &br, ostream &s)
+{
+  if (br.target == block + 1) {
+    code_cond(cmp, br.a, true, br.other, s);
+    return;
+  }
+  code_cond(cmp, br.a, false, br.target, s);
+  if (br.other != block + 1) {
+    s << "\tjmp\t";
+    label_ref(br.other, s);
+    s << endl;
+  }
+}
+
+//
+// The table holds the offset of each block from the table, as a
+// position-independent switch does; it goes in .rodata.  One unsigned
+// comparison checks both ends of the range.
+//
+void X86Lowering::code_switch(const IRInsn &in, ostream &s)
+{
+  int n = in.table.size(), table = label_index++;
+  const X86Reg *x = use(in.a, &RAX, s);
+  if (x != &RAX)
+    s << "\tmovl\t" << x->d << ", %eax" << endl;
+  if (in.imm)
+    s << "\tsubl\t$" << in.imm << ", %eax" << endl;
+  s << "\tcmpl\t$" << n - 1 << ", %eax" << endl
+    << "\tja\t";
+  label_ref(in.other, s);
+  s << endl << "\tleaq\t";
+  emit_label_ref(table, s);
+  s << "(%rip), %rdx" << endl
+    << "\tmovslq\t(%rdx,%rax,4), %rax" << endl
+    << "\taddq\t%rdx, %rax" << endl
+    << "\tjmp\t*%rax" << endl;
+
+  tables << "\t.section\t.rodata" << endl
+         << "\t.balign\t4" << endl;
+  emit_label_ref(table, tables);
+  tables << LABEL;
+  for (int b : in.table) {
+    tables << "\t.long\t";
+    label_ref(b, tables);
+    tables << " - ";
+    emit_label_ref(table, tables);
+    tables << endl;
+  }
+  tables << "\t.text" << endl;
+}
+
+void X86Lowering::code_insn(const IRInsn &in, ostream &s)
+{
+  const X86Reg *x, *y, *d;
+  int imm;
+
+  switch (in.op) {
+  case IR_LI:
+  case IR_LA:
+    if (alloc.homes[in.d].kind == HOME_CONST)
+      break;
+    d = target(in.d, &RAX);
+    if (in.op == IR_LI)
+      s << "\tmovl\t$" << in.imm << ", " << d->d << endl;
+    else
+      s << "\tleaq\t" << in.label << "(%rip), " << d->q << endl;
+    define(in.d, d, s);
+    break;
+  case IR_MOVE:
+    d = target(in.d, &RAX);
+    x = use(in.a, d, s);
+    if (x != d)
+      s << "\tmovq\t" << x->q << ", " << d->q << endl;
+    define(in.d, d, s);
+    break;
+  case IR_ARG:
+    if (alloc.homes[in.d].kind == HOME_ARG && alloc.homes[in.d].index == in.imm)
+      break;
+    d = target(in.d, &RAX);
+    s << "\tmovq\t" << 8 * (fn.nargs - in.imm + 1) << "(%rbp), " << d->q << endl;
+    define(in.d, d, s);
+    break;
+  case IR_ADD:
+  case IR_SUB:
+  case IR_MUL: {
+    const char *op = in.op == IR_ADD ? "addl" : in.op == IR_SUB ? "subl" : "imull";
+    x = use(in.a, &R10, s);
+    d = target(in.d, &RAX);
+    if (const_imm(in.b, imm)) {
+      if (x != d)
+        s << "\tmovl\t" << x->d << ", " << d->d << endl;
+      s << "\t" << op << "\t$" << imm << ", " << d->d << endl;
+    } else {
+      y = use(in.b, &R11, s);
+      if (d == y)
+        d = &RAX;
+      if (x != d)
+        s << "\tmovl\t" << x->d << ", " << d->d << endl;
+      s << "\t" << op << "\t" << y->d << ", " << d->d << endl;
+    }
+    // add and sub trap on overflow on MIPS; imull wraps like mul
+    if (in.op != IR_MUL)
+      code_trap("o", "_overflow_abort", in.line, s);
+    define(in.d, d, s);
+    break;
+  }
+  case IR_DIV: {
+    // idivl faults on the most negative Int divided by -1, which
+    // MIPS leaves as it is, so -1 negates instead
+    int divide = label_index++, done = label_index++;
+    x = use(in.a, &R10, s);
+    s << "\tmovl\t" << x->d << ", %eax" << endl;
+    y = use(in.b, &R11, s);
+    s << "\ttestl\t" << y->d << ", " << y->d << endl;
+    code_trap("e", "_divide_abort", in.line, s);
+    s << "\tcmpl\t$-1, " << y->d << endl
+      << "\tjne\t";
+    emit_label_ref(divide, s);
+    s << endl
+      << "\tnegl\t%eax" << endl
+      << "\tjmp\t";
+    emit_label_ref(done, s);
+    s << endl;
+    emit_label_ref(divide, s);
+    s << LABEL
+      << "\tcltd" << endl
+      << "\tidivl\t" << y->d << endl;
+    emit_label_ref(done, s);
+    s << LABEL;
+    define(in.d, &RAX, s);
+    break;
+  }
+  case IR_LT:
+  case IR_LE:
+  case IR_EQ:
+    code_compare(in, s);
+    d = target(in.d, &RAX);
+    s << "\t" << (in.op == IR_LT ? "setl" : in.op == IR_LE ? "setle" : "sete")
+      << "\t%al" << endl
+      << "\tmovzbl\t%al, " << d->d << endl;
+    define(in.d, d, s);
+    break;
+  case IR_NEG:
+  case IR_NOT:
+    x = use(in.a, &R10, s);
+    d = target(in.d, &RAX);
+    if (x != d)
+      s << "\tmovl\t" << x->d << ", " << d->d << endl;
+    if (in.op == IR_NEG) {
+      s << "\tnegl\t" << d->d << endl;
+      code_trap("o", "_overflow_abort", in.line, s);
+    } else
+      s << "\txorl\t$1, " << d->d << endl;
+    define(in.d, d, s);
+    break;
+  case IR_ISVOID:
+    x = use(in.a, &R10, s);
+    d = target(in.d, &RAX);
+    s << "\ttestq\t" << x->q << ", " << x->q << endl
+      << "\tsete\t%al" << endl
+      << "\tmovzbl\t%al, " << d->d << endl;
+    define(in.d, d, s);
+    break;
+  case IR_LOAD:
+  case IR_UNBOX:
+    x = use(in.a, &R10, s);
+    d = target(in.d, &RAX);
+    if (fn.vregs[in.d] == IR_WORD)
+      s << "\tmovl\t";
+    else
+      s << "\tmovq\t";
+    s << 8 * (in.op == IR_LOAD ? in.imm : DEFAULT_OBJFIELDS) << "(" << x->q << "), "
+      << (fn.vregs[in.d] == IR_WORD ? d->d : d->q) << endl;
+    define(in.d, d, s);
+    break;
+  case IR_STORE:
+    x = use(in.a, &R10, s);
+    y = use(in.b, &R11, s);
+    s << "\tmovq\t" << y->q << ", " << 8 * in.imm << "(" << x->q << ")" << endl;
+    break;
+  case IR_BOX_INT:
+    s << "\tleaq\t" << Int << PROTOBJ_SUFFIX << "(%rip), %rax" << endl
+      << "\tcall\tObject.copy" << endl;
+    y = use(in.a, &R11, s);
+    s << "\tmovl\t" << y->d << ", " << 8 * DEFAULT_OBJFIELDS << "(%rax)" << endl;
+    define(in.d, &RAX, s);
+    break;
+  case IR_BOX_BOOL:
+    d = target(in.d, &RAX);
+    if (const_imm(in.a, imm)) {
+      s << "\tleaq\t";
+      BoolConst(imm).code_ref(s);
+      s << "(%rip), " << d->q << endl;
+    } else {
+      x = use(in.a, &R10, s);
+      if (d == x)
+        d = &RAX;
+      s << "\tleaq\t";
+      BoolConst(0).code_ref(s);
+      s << "(%rip), " << d->q << endl
+        << "\tleaq\t";
+      BoolConst(1).code_ref(s);
+      s << "(%rip), %r11" << endl
+        << "\ttestl\t" << x->d << ", " << x->d << endl
+        << "\tcmovneq\t%r11, " << d->q << endl;
+    }
+    define(in.d, d, s);
+    break;
+  case IR_NEW:
+  case IR_NEW_PROTO:
+    code_new(in, s);
+    define(in.d, &RAX, s);
+    break;
+  case IR_NEW_SELF:
+    // class_objTab holds the prototype and init routine of each tag
+    s << "\tmovq\t(%rbx), %r10" << endl
+      << "\tshlq\t$4, %r10" << endl
+      << "\tleaq\t" << CLASSOBJTAB << "(%rip), %r11" << endl
+      << "\taddq\t%r11, %r10" << endl
+      << "\tpushq\t%r10" << endl
+      << "\tmovq\t(%r10), %rax" << endl
+      << "\tcall\tObject.copy" << endl
+      << "\tpopq\t%r10" << endl
+      << "\tcall\t*8(%r10)" << endl;
+    define(in.d, &RAX, s);
+    break;
+  case IR_DISPATCH:
+  case IR_STATIC_DISPATCH:
+    code_call(in, s);
+    break;
+  case IR_OBJ_EQ:
+    x = use(in.a, &R10, s);
+    if (x != &R10)
+      s << "\tmovq\t" << x->q << ", %r10" << endl;
+    y = use(in.b, &R11, s);
+    if (y != &R11)
+      s << "\tmovq\t" << y->q << ", %r11" << endl;
+    s << "\tcall\tequality_test" << endl;
+    define(in.d, &RAX, s);
+    break;
+  case IR_INIT:
+    s << "\tmovq\t%rbx, %rax" << endl
+      << "\tcall\t" << in.label << CLASSINIT_SUFFIX << endl;
+    break;
+  case IR_PRINT_INT:
+    x = use(in.b, &R11, s);
+    if (in.b != 0)
+      code_void_check(x, in.line, s);
+    x = use(in.a, &RAX, s);
+    if (x != &RAX)
+      s << "\tmovl\t" << x->d << ", %eax" << endl;
+    s << "\tcall\t_out_int" << endl;
+    break;
+  case IR_CHECK_VOID:
+    code_void_check(use(in.a, &R11, s), in.line, s);
+    break;
+  case IR_JUMP:
+    if (in.target != block + 1) {
+      s << "\tjmp\t";
+      label_ref(in.target, s);
+      s << endl;
+    }
+    break;
+  case IR_BRANCH:
+    code_branch(NULL, in, s);
+    break;
+  case IR_SWITCH:
+    code_switch(in, s);
+    break;
+  case IR_RETURN:
+    x = use(in.a, &RAX, s);
+    if (x != &RAX)
+      s << "\tmovq\t" << x->q << ", %rax" << endl;
+    code_epilogue(s);
+    break;
+  case IR_ABORT_CASE_VOID:
+    s << "\tleaq\t";
+    filename->code_ref(s);
+    s << "(%rip), %rdi" << endl
+      << "\tmovl\t$" << in.line << ", %esi" << endl
+      << "\tcall\t_case_abort2" << endl;
+    break;
+  case IR_ABORT_CASE:
+    x = use(in.a, &RAX, s);
+    s << "\tmovq\t" << x->q << ", %rdi" << endl
+      << "\tcall\t_case_abort" << endl;
+    break;
+  }
+}
+
+void X86Lowering::code(ostream &s)
+{
+  if (cgen_debug)
+    fn.print(s, "# ");
+  code_prologue(s);
+
+  std::vector<std::string> text(fn.blocks.size());
+  for (block = 0; block < int(fn.blocks.size()); block++) {
+    std::ostringstream bs;
+    const std::vector<IRInsn> &insns = fn.blocks[block].insns;
+    for (size_t i = 0; i < insns.size(); i++) {
+      const IRInsn &in = insns[i];
+      if (i + 2 == insns.size() && insns[i + 1].op == IR_BRANCH &&
+          insns[i + 1].a == in.d && alloc.use_count[in.d] == 1 &&
+          (in.op == IR_LT || in.op == IR_LE || in.op == IR_EQ ||
+           in.op == IR_ISVOID || in.op == IR_NOT)) {
+        code_branch(&in, insns[i + 1], bs);
+        break;
+      }
+      code_insn(in, bs);
+      // a tail call has returned for the function
+      if (in.tail)
+        break;
+    }
+    text[block] = bs.str();
+  }
+
+  for (size_t b = 0; b < text.size(); b++) {
+    if (referenced[b]) {
+      emit_label_ref(labels[b], s);
+      s << LABEL;
+    }
+    s << text[b];
+  }
+  s << traps.str()
+    << tables.str();
+}
+
+void code_x86_64_function(IRFunction &fn, CgenNodeP curr, ostream &s)
+{
+  X86Lowering(fn, curr).code(s);
+}
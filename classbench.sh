@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# Times the code generator on generated programs with a growing
+# number of classes.  The classes form a binary tree; each overrides
+# a method, calls a few others and has a case on itself and the
+# root, so the program grows linearly with the class count and any
+# superlinear growth in the time is the code generator's.
+#
+#    ./classbench.sh [cgen] [counts...]
+#
+CGEN=${1:-./cgen}
+shift
+COUNTS=${@:-100 200 400 800}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+for n in $COUNTS; do
+  prog=$TMP/stress$n.cl
+  {
+    echo "class C0 inherits IO { f(x : Int) : Int { x }; g(o : Object) : Int { 0 }; };"
+    for ((i = 1; i < n; i++)); do
+      echo "class C$i inherits C$(( (i - 1) / 2 )) {"
+      echo "  a$i : Int <- $i;"
+      echo "  f(x : Int) : Int { x + a$i + g(self) };"
+      echo "  g(o : Object) : Int { case o of c : C$i => f(1); c0 : C0 => 0; o : Object => 3; esac };"
+      echo "};"
+    done
+    echo "class Main { main() : Object { (new C$((n - 1))).f(0) }; };"
+  } > $prog
+  $DIR/lexer $prog | $DIR/parser | $DIR/semant > $prog.ast
+  TIMEFORMAT="$n classes: %R s"
+  time $CGEN -o $TMP/stress$n.s < $prog.ast
+done
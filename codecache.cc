@@ -0,0 +1,160 @@
+//**************************************************************
+//
+// Code cache.  See codecache.h.
+//
+//**************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sstream>
+#include "astbin.h"
+#include "cgen.h"
+#include "cgen_gc.h"
+#include "codecache.h"
+
+extern int cgen_debug, cgen_optimize, disable_reg_alloc;
+
+// 128-bit FNV-1a, in hex
+static std::string digest(const std::string &s)
+{
+  unsigned __int128 h = ((unsigned __int128)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+  const unsigned __int128 prime = ((unsigned __int128)1 << 88) | 0x13b;
+  for (unsigned char c : s)
+    h = (h ^ c) * prime;
+  char hex[33];
+  snprintf(hex, sizeof(hex), "%016llx%016llx",
+           (unsigned long long)(h >> 64), (unsigned long long)h);
+  return hex;
+}
+
+//
+// StringTable (stringtab.h, from the course) keeps its list protected
+// and has no accessor for it.  A pointer to the member, named through
+// a subclass, reaches it on any table.
+//
+template <class Elem> struct TableList : public StringTable<Elem>
+{
+  static List<Elem> *list(StringTable<Elem> &t) { return t.*&TableList::tbl; }
+  static int size(StringTable<Elem> &t) { return t.*&TableList::index; }
+};
+
+//
+// The label of a constant is numbered by its index in its table.  The
+// tables only look entries up by index by walking their list, newest
+// first, so the list is walked here once instead.
+//
+template <class Elem> static void number(StringTable<Elem> &t,
+                                         std::unordered_map<Symbol, unsigned> &constants)
+{
+  int i = TableList<Elem>::size(t);
+  for (List<Elem> *e = TableList<Elem>::list(t); e; e = e->tl()) {
+    --i;
+    assert(e->hd()->equal_index(i));
+    constants[e->hd()] = i;
+  }
+}
+
+CodeCache::CodeCache(const char *d, const std::vector<CgenNodeP> &classes)
+  : dir(d), hits(0), misses(0)
+{
+  mkdir(d, 0777);
+  number(stringtable, constants);
+  number(inttable, constants);
+
+  // a rebuilt cgen may generate different code
+  struct stat exe = {};
+  stat("/proc/self/exe", &exe);
+
+  std::ostringstream s;
+  s << exe.st_size << " " << exe.st_mtim.tv_sec << "." << exe.st_mtim.tv_nsec << "\n"
+    << cgen_target << " " << cgen_debug << " " << cgen_optimize << " "
+    << disable_reg_alloc << " " << cgen_Memmgr << " " << cgen_Memmgr_Test << " "
+    << cgen_Memmgr_Debug << " " << cgen_inline << "\n";
+  AstWriter w(s, constants);
+  for (CgenNodeP c : classes) {
+    s << c->name << " " << c->tag << " " << c->get_parent() << " " << c->trivial_init << "\n";
+    for (auto &slot : c->dispatch_table)
+      s << " " << slot.second << "." << slot.first;
+    s << "\n";
+    for (attr_class *attr : c->attr_layout)
+      s << " " << attr->name << ":" << attr->type_decl;
+    s << "\n";
+    // the methods that may be inlined into other classes' code, and
+    // the attributes that its descendants' init routines initialize
+    for (int i = c->features->first(); c->features->more(i); i = c->features->next(i)) {
+      Feature f = c->features->nth(i);
+      if (f->is_method() ? c->inlinable.count(((method_class *)f)->name) > 0
+                         : c->max_tag > c->tag)
+        f->dump_binary(w);
+    }
+  }
+  program = digest(s.str());
+}
+
+std::string CodeCache::key(CgenNodeP c)
+{
+  std::ostringstream s;
+  s << program;
+  AstWriter w(s, constants);
+  c->dump_binary(w);
+  return s.str();
+}
+
+std::string CodeCache::path(const std::string &key)
+{
+  return dir + "/" + digest(key);
+}
+
+//
+// An entry is the length of the key in decimal and a newline, the key,
+// and the code.
+//
+bool CodeCache::lookup(const std::string &key, std::string &code)
+{
+  FILE *f = fopen(path(key).c_str(), "rb");
+  std::string entry;
+  if (f) {
+    struct stat st;
+    if (fstat(fileno(f), &st) == 0) {
+      entry.resize(st.st_size);
+      entry.resize(fread(&entry[0], 1, entry.size(), f));
+    }
+    fclose(f);
+  }
+
+  size_t nl = entry.find('\n');
+  if (nl != std::string::npos) {
+    size_t len = strtoul(entry.c_str(), NULL, 10);
+    if (entry.size() - nl - 1 >= len && entry.compare(nl + 1, len, key) == 0) {
+      code = entry.substr(nl + 1 + len);
+      hits++;
+      return true;
+    }
+  }
+  misses++;
+  return false;
+}
+
+void CodeCache::store(const std::string &key, const std::string &code)
+{
+  std::string p = path(key);
+  std::string tmp = p + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    return;
+  FILE *f = fdopen(fd, "wb");
+  bool ok = f && fprintf(f, "%zu\n", key.size()) > 0 &&
+            fwrite(key.data(), 1, key.size(), f) == key.size() &&
+            fwrite(code.data(), 1, code.size(), f) == code.size();
+  if (f ? fclose(f) != 0 : close(fd) != 0)
+    ok = false;
+  if (!ok || rename(tmp.c_str(), p.c_str()) != 0)
+    unlink(tmp.c_str());
+}
+
+void CodeCache::print_stats(std::ostream &s)
+{
+  s << "code cache: " << hits << " hits, " << misses << " misses" << std::endl;
+}
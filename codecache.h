@@ -0,0 +1,69 @@
+#ifndef CODECACHE_H
+#define CODECACHE_H
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "cool-tree.h"
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Code cache
+//
+//  With COOL_CACHE set to a directory, the code traverse_tree
+//  generates for each class (its init routine and its methods) is kept
+//  there, and a later compile that would generate the same code for
+//  the class takes it from there instead.
+//
+//  The code for a class is determined by the class itself, written as
+//  an AstWriter key, which has the numbers of the labels of the
+//  constants it uses; by the shape of the whole program, which is
+//  every class's name, tag, parent, dispatch table and attribute
+//  layout, whether its init routine is trivial, the methods small
+//  enough to be inlined (see find_inlinable) and the attributes of the
+//  classes that have subclasses, whose init routines initialize them
+//  too (see code_init); and by the target, the flags and the build of
+//  cgen.  A class's key is a hash of all but the first, followed by the
+//  first, and its entry is the file named by a hash of the key, holding
+//  the key and the code.  The key is compared in full when an entry is
+//  read, so a collision of the second hash is only a miss.
+//
+//  So changing the body of a method other than an inlined one, or the
+//  initializer of an attribute of a class without subclasses (short of
+//  making its init routine trivial or not), leaves every other class's
+//  code in the cache, but adding a method or an attribute or a class
+//  misses for the lot.  So does a change that moves the classes after
+//  it to other lines, since the line numbers are in the code, or that
+//  adds a constant, which renumbers the constants after it.
+//
+//  Entries are written to a temporary file and renamed into place, so
+//  that compiles can share the directory.
+//
+//////////////////////////////////////////////////////////////////////
+
+class CgenNode;
+typedef CgenNode *CgenNodeP;
+
+class CodeCache
+{
+private:
+  std::string dir;
+  std::string program;                                // hash of the rest of the key
+  std::unordered_map<Symbol, unsigned> constants;     // by their labels' numbers
+  std::atomic<int> hits, misses;
+
+  std::string path(const std::string &key);
+
+public:
+  CodeCache(const char *dir, const std::vector<CgenNodeP> &classes);
+
+  std::string key(CgenNodeP c);
+  bool lookup(const std::string &key, std::string &code);
+  void store(const std::string &key, const std::string &code);
+
+  void print_stats(std::ostream &s);
+};
+
+#endif
@@ -5,15 +5,20 @@
 #define COOL_TREE_HANDCODE_H
 
 #include <iostream>
+#include <vector>
 #include "tree.h"
 #include "cool.h"
 #include "stringtab.h"
+#include "symtab.h"
+#include "arena.h"
 #define yylineno curr_lineno;
 extern int yylineno;
 class CgenNode;
 typedef CgenNode *CgenNodeP;
 
 class CgenClassTable;
+class IRBuilder;
+class AstWriter;
 
 inline Boolean copy_Boolean(Boolean b) {return b; }
 inline void assert_Boolean(Boolean) {}
@@ -48,79 +53,147 @@ typedef Expressions_class *Expressions;
 typedef list_node<Case> Cases_class;
 typedef Cases_class *Cases;
 
+// Constant folding maps each variable in scope to its constant value,
+// or to NULL if it has none.
+typedef SymbolTable<Symbol, Expression_class> ConstEnv;
+
 #define Program_EXTRAS                          \
+ARENA_ALLOCATED                                 \
 virtual void cgen(ostream&) = 0;		\
-virtual void dump_with_types(ostream&, int) = 0; 
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 
 #define program_EXTRAS                          \
 void cgen(ostream&);     			\
-void dump_with_types(ostream&, int);            
+void dump_with_types(ostream&, int);            \
+void dump_binary(AstWriter&);
 
 #define Class__EXTRAS                   \
+ARENA_ALLOCATED                         \
 virtual Symbol get_name() = 0;  	\
 virtual Symbol get_parent() = 0;    	\
 virtual Symbol get_filename() = 0;      \
-virtual void dump_with_types(ostream&,int) = 0; 
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define class__EXTRAS                                  \
 Symbol get_name()   { return name; }		       \
 Symbol get_parent() { return parent; }     	       \
 Symbol get_filename() { return filename; }             \
-void dump_with_types(ostream&,int);                    
+void dump_with_types(ostream&,int);                    \
+void dump_binary(AstWriter&);
 
 
 #define Feature_EXTRAS                                        \
-virtual void dump_with_types(ostream&,int) = 0; 
+ARENA_ALLOCATED                                               \
+virtual void dump_with_types(ostream&,int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 
 #define Feature_SHARED_EXTRAS                                       \
-void dump_with_types(ostream&,int);    
+void dump_with_types(ostream&,int);    \
+void dump_binary(AstWriter&);
 
 
 #define Formal_EXTRAS              \
+ARENA_ALLOCATED            \
 virtual Symbol get_name() = 0; \
 virtual Symbol get_type() = 0; \
-virtual void dump_with_types(ostream&, int) = 0;
+virtual void dump_with_types(ostream&, int) = 0; \
+virtual void dump_binary(AstWriter&) = 0;
 
 #define formal_EXTRAS                       \
 Symbol get_name() { return name; }      \
 Symbol get_type() { return type_decl; } \
-void dump_with_types(ostream&, int);
+void dump_with_types(ostream&, int); \
+void dump_binary(AstWriter&);
 
 
 #define Case_EXTRAS                          \
+	ARENA_ALLOCATED                          \
 	virtual Symbol get_name() = 0;           \
 	virtual Symbol get_type() = 0;           \
 	virtual Expression get_expression() = 0; \
-	virtual void dump_with_types(ostream &, int) = 0;
+	virtual void dump_with_types(ostream &, int) = 0; \
+	virtual void dump_binary(AstWriter &) = 0;
 
 #define branch_EXTRAS                             \
 	Symbol get_name() { return name; }            \
 	Symbol get_type() { return type_decl; }       \
 	Expression get_expression() { return expr; }; \
-	void dump_with_types(ostream &, int);
+	void dump_with_types(ostream &, int); \
+	void dump_binary(AstWriter &);
 
 
 #define Expression_EXTRAS                    \
+ARENA_ALLOCATED                              \
 Symbol type;                                 \
 Symbol get_type() { return type; }           \
 Expression set_type(Symbol s) { type = s; return this; } \
-virtual void code(ostream&, CgenNodeP, CgenClassTable* ) = 0; \
+virtual int code(IRBuilder&) = 0; \
+virtual int code_unboxed(IRBuilder&); \
+virtual bool has_unboxed_code() {return false;} \
+virtual bool boxes_var(Symbol) = 0; \
+virtual Expression fold(ConstEnv&) = 0; \
+virtual bool assigns_var(Symbol) = 0; \
+virtual int inline_size() = 0; \
+virtual bool int_value(int&) {return false;} \
+virtual bool bool_value(bool&) {return false;} \
+virtual Symbol var_name() {return NULL;} \
 virtual void dump_with_types(ostream&,int) = 0;  \
+virtual void dump_binary(AstWriter&) = 0; \
 void dump_type(ostream&, int);               \
 virtual bool is_no_expr() {return false;} \
 Expression_class() { type = (Symbol) NULL; }
 
 #define Expression_SHARED_EXTRAS           \
-void code(ostream&, CgenNodeP, CgenClassTable*); 			   \
-void dump_with_types(ostream&,int); 
+int code(IRBuilder&); 			   \
+bool boxes_var(Symbol); \
+Expression fold(ConstEnv&); \
+bool assigns_var(Symbol); \
+int inline_size(); \
+void dump_with_types(ostream&,int); \
+void dump_binary(AstWriter&);
+
+// Expressions that can compute an Int or Bool value as a raw machine
+// word without allocating a box for it.
+#define UNBOXED_EXTRAS \
+int code_unboxed(IRBuilder&) override; \
+bool has_unboxed_code() override {return true;}
+
+#define assign_EXTRAS UNBOXED_EXTRAS
+#define cond_EXTRAS UNBOXED_EXTRAS
+#define block_EXTRAS UNBOXED_EXTRAS
+#define let_EXTRAS UNBOXED_EXTRAS
+#define plus_EXTRAS UNBOXED_EXTRAS
+#define sub_EXTRAS UNBOXED_EXTRAS
+#define mul_EXTRAS UNBOXED_EXTRAS
+#define divide_EXTRAS UNBOXED_EXTRAS
+#define neg_EXTRAS UNBOXED_EXTRAS
+#define lt_EXTRAS UNBOXED_EXTRAS
+#define eq_EXTRAS UNBOXED_EXTRAS
+#define leq_EXTRAS UNBOXED_EXTRAS
+#define comp_EXTRAS UNBOXED_EXTRAS
+#define isvoid_EXTRAS UNBOXED_EXTRAS
 
 
 
 #define no_expr_EXTRAS \
 bool is_no_expr() override {return true;}
 
+#define int_const_EXTRAS \
+UNBOXED_EXTRAS \
+bool int_value(int&) override;
+
+#define bool_const_EXTRAS \
+UNBOXED_EXTRAS \
+bool bool_value(bool &v) override {v = val; return true;}
+
+#define object_EXTRAS \
+UNBOXED_EXTRAS \
+Symbol var_name() override {return name;}
+
 #endif
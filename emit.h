@@ -21,9 +21,11 @@
 // Global names
 #define CLASSNAMETAB         "class_nameTab"
 #define CLASSOBJTAB          "class_objTab"
+#define CLASSRANGETAB        "class_rangeTab"
 #define INTTAG               "_int_tag"
 #define BOOLTAG              "_bool_tag"
 #define STRINGTAG            "_string_tag"
+#define BOXWORD              "_box_word"
 #define HEAP_START           "heap_start"
 
 // Naming conventions
@@ -53,6 +55,9 @@
 #define SIZE_OFFSET 1
 #define DISPTABLE_OFFSET 2
 
+// objects up to this many words are allocated inline
+#define MAX_INLINE_NEW 16
+
 #define STRING_SLOTS      1
 #define INT_SLOTS         1
 #define BOOL_SLOTS        1
@@ -74,6 +79,16 @@
 #define SP   "$sp"		// Stack pointer 
 #define FP   "$fp"		// Frame pointer 
 #define RA   "$ra"		// Return address 
+#define HEAP_PTR   "$gp"	// Next free word of the heap (runtime)
+#define HEAP_LIMIT "$s7"	// End of the heap (runtime)
+
+//
+// Registers for values.  Calls don't preserve the first pool, but
+// $s1-$s6 are callee saved.  $s7 and $gp belong to the runtime's
+// memory manager; $a0, $a1, $t1, $t2 and $v0 are scratch.
+//
+#define NUM_CALLER_REGS 8
+#define NUM_CALLEE_REGS 6
 
 //
 // Opcodes
@@ -81,6 +96,8 @@
 #define JALR  "\tjalr\t"  
 #define JAL   "\tjal\t"                 
 #define RET   "\tjr\t"RA"\t"
+#define J     "\tj\t"
+#define JR    "\tjr\t"
 
 #define SW    "\tsw\t"
 #define LW    "\tlw\t"
@@ -97,12 +114,18 @@
 #define MUL   "\tmul\t"
 #define SUB   "\tsub\t"
 #define SLL   "\tsll\t"
+#define XORI  "\txori\t"
+#define SLT   "\tslt\t"
+#define SLE   "\tsle\t"
+#define SEQ   "\tseq\t"
 #define BEQZ  "\tbeqz\t"
+#define BNEZ  "\tbnez\t"
 #define BRANCH   "\tb\t"
 #define BEQ      "\tbeq\t"
 #define BNE      "\tbne\t"
 #define BLEQ     "\tble\t"
 #define BLT      "\tblt\t"
 #define BGT      "\tbgt\t"
+#define BGE      "\tbge\t"
 
 
@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# Runs a program that keeps Ints with heap addresses for values live
+# across allocations, in mipsim with a collector (-g), with and without
+# -O and in GC test mode (-t).  mipsim stops the run if such an Int is
+# left on the stack where the collector would take it for a pointer.
+#
+#    make mipsim
+#    ./gccheck.sh [cgen]
+#
+CGEN=${1:-./cgen}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+cat > $TMP/words.cl <<COOL
+class Cell { n : Int; next : Cell; };
+class Main inherits IO {
+  keep(n : Int) : Int {
+    let x : Int <- n * 4 + 268500000, c : Cell <- new Cell, small : Bool <- n < 5 in
+      { c <- new Cell; if small then x + 1 else x - 1 fi; }
+  };
+  main() : Object {
+    let i : Int <- 0, sum : Int <- 0 in {
+      while i < 1000 loop {
+        sum <- keep(i) - 268500000 + sum;
+        i <- i + 1;
+      } pool;
+      out_int(sum);
+      out_string("\n");
+    }
+  };
+};
+COOL
+$DIR/lexer $TMP/words.cl | $DIR/parser | $DIR/semant > $TMP/words.ast
+
+for opt in -g "-g -O" "-g -t" "-g -t -O"; do
+  echo "cgen $opt:"
+  $CGEN $opt -o $TMP/words.s < $TMP/words.ast
+  $DIR/mipsim $TMP/words.s 2>&1 | grep -v "successfully executed"
+done
@@ -0,0 +1,800 @@
+//**************************************************************
+//
+// Three-address intermediate code: printing, liveness and
+// register allocation.  See ir.h.
+//
+//**************************************************************
+
+#include <algorithm>
+#include <climits>
+#include "ir.h"
+
+static const char *op_names[] =
+{
+  "li", "la", "move", "arg", "add", "sub", "mul", "div", "lt", "le", "eq",
+  "neg", "not", "isvoid", "load", "unbox", "box_int", "box_bool", "new",
+  "new_proto", "new_self", "dispatch", "static_dispatch", "obj_eq", "store", "init",
+  "print_int", "check_void", "jump", "branch", "switch", "return", "abort_case_void",
+  "abort_case"
+};
+
+bool IRInsn::is_call() const
+{
+  switch (op) {
+  case IR_BOX_INT:
+  case IR_NEW:
+  case IR_NEW_PROTO:
+  case IR_NEW_SELF:
+  case IR_DISPATCH:
+  case IR_STATIC_DISPATCH:
+  case IR_OBJ_EQ:
+  case IR_INIT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void IRInsn::uses(std::vector<int> &regs) const
+{
+  regs.clear();
+  if (a >= 0)
+    regs.push_back(a);
+  if (b >= 0)
+    regs.push_back(b);
+  for (int arg : args)
+    regs.push_back(arg);
+}
+
+std::vector<int> IRInsn::successors() const
+{
+  std::vector<int> succ;
+  if (op == IR_JUMP || op == IR_BRANCH)
+    succ.push_back(target);
+  if (op == IR_BRANCH || op == IR_SWITCH)
+    succ.push_back(other);
+  succ.insert(succ.end(), table.begin(), table.end());
+  return succ;
+}
+
+void IRFunction::print(std::ostream &s, const char *prefix)
+{
+  s << prefix << name << " (" << nargs << " args)" << std::endl;
+  for (size_t i = 0; i < blocks.size(); i++) {
+    s << prefix << "B" << i;
+    if (blocks[i].depth)
+      s << " (loop depth " << blocks[i].depth << ")";
+    s << ":" << std::endl;
+    for (const IRInsn &in : blocks[i].insns) {
+      s << prefix << "\t";
+      if (in.d >= 0)
+        s << "v" << in.d << (vregs[in.d] == IR_WORD ? "w" : "") << " = ";
+      s << op_names[in.op] << (in.tail ? " tail" : "");
+      if (!in.label.empty())
+        s << " " << in.label;
+      if (in.op == IR_LI || in.op == IR_ARG || in.op == IR_LOAD ||
+          in.op == IR_STORE || in.op == IR_DISPATCH || in.op == IR_SWITCH ||
+          in.op == IR_NEW || in.op == IR_NEW_PROTO)
+        s << " #" << in.imm;
+      if (in.a >= 0)
+        s << " v" << in.a;
+      if (in.b >= 0)
+        s << " v" << in.b;
+      if (!in.args.empty()) {
+        s << " (";
+        for (size_t j = 0; j < in.args.size(); j++)
+          s << (j ? " v" : "v") << in.args[j];
+        s << ")";
+      }
+      if (in.target >= 0)
+        s << " B" << in.target;
+      if (in.other >= 0)
+        s << " B" << in.other;
+      if (!in.table.empty()) {
+        s << " [";
+        for (size_t j = 0; j < in.table.size(); j++)
+          s << (j ? " B" : "B") << in.table[j];
+        s << "]";
+      }
+      s << std::endl;
+    }
+  }
+}
+
+int mark_tail_calls(IRFunction &fn)
+{
+  int marked = 0;
+  for (IRBlock &block : fn.blocks) {
+    std::vector<IRInsn> &insns = block.insns;
+    const IRInsn &last = insns.back();
+    int result;
+    if (last.op == IR_RETURN)
+      result = last.a;
+    else if (last.op == IR_JUMP && fn.blocks[last.target].insns.size() == 1 &&
+             fn.blocks[last.target].insns[0].op == IR_RETURN)
+      result = fn.blocks[last.target].insns[0].a;
+    else
+      continue;
+
+    int i = insns.size() - 2;
+    bool moved = i >= 0 && insns[i].op == IR_MOVE && insns[i].d == result;
+    if (moved)
+      result = insns[i--].a;
+    if (i < 0 || insns[i].d != result ||
+        (insns[i].op != IR_DISPATCH && insns[i].op != IR_STATIC_DISPATCH))
+      continue;
+
+    insns[i].tail = true;
+    insns.erase(insns.begin() + i + 1, insns.end());
+    IRInsn ret(IR_RETURN);
+    ret.a = result;
+    insns.push_back(ret);
+    marked++;
+  }
+  return marked;
+}
+
+//
+// The builder lays out a while loop's blocks in one run, the test
+// first, so a loop is the blocks from the target of a back edge to the
+// last block that jumps back to it.  It is only worked on if that is
+// its only way in and the block before it jumps there: that block is
+// its preheader, where the hoisted instructions go.
+//
+struct Loop
+{
+  int head, tail;         // its first and last block
+  int preheader;
+  bool contains(int b) const { return head <= b && b <= tail; }
+};
+
+// Whether an instruction may write an attribute of any object.
+static bool may_store(const IRInsn &in)
+{
+  switch (in.op) {
+  case IR_NEW:
+  case IR_NEW_SELF:
+  case IR_DISPATCH:
+  case IR_STATIC_DISPATCH:
+  case IR_STORE:
+  case IR_INIT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Inserts in before the terminator of block b.
+static void insert_at_end(IRFunction &fn, int b, const IRInsn &in)
+{
+  std::vector<IRInsn> &insns = fn.blocks[b].insns;
+  insns.insert(insns.end() - 1, in);
+}
+
+static std::vector<Loop> find_loops(IRFunction &fn)
+{
+  std::vector<Loop> loops;
+  for (size_t b = 0; b < fn.blocks.size(); b++)
+    for (int succ : fn.blocks[b].insns.back().successors())
+      if (succ <= int(b)) {
+        auto l = std::find_if(loops.begin(), loops.end(),
+                              [&](const Loop &l) { return l.head == succ; });
+        if (l == loops.end())
+          loops.push_back(Loop{succ, int(b), -1});
+        else
+          l->tail = std::max(l->tail, int(b));
+      }
+
+  std::vector<Loop> found;
+  for (Loop &l : loops) {
+    if (l.head == 0 || fn.blocks[l.head - 1].insns.back().op != IR_JUMP)
+      continue;
+    bool ok = true;
+    for (size_t b = 0; b < fn.blocks.size(); b++)
+      for (int succ : fn.blocks[b].insns.back().successors())
+        if (!l.contains(b) && l.contains(succ) && int(b) != l.head - 1)
+          ok = false;
+    if (ok) {
+      l.preheader = l.head - 1;
+      found.push_back(l);
+    }
+  }
+  std::stable_sort(found.begin(), found.end(), [](const Loop &x, const Loop &y) {
+    return x.tail - x.head < y.tail - y.head;
+  });
+  return found;
+}
+
+//
+// The uses of each register, as the instructions that read it.
+//
+static std::vector<std::vector<IRInsn *> > find_uses(IRFunction &fn)
+{
+  std::vector<std::vector<IRInsn *> > users(fn.vregs.size());
+  std::vector<int> regs;
+  for (IRBlock &block : fn.blocks)
+    for (IRInsn &in : block.insns) {
+      in.uses(regs);
+      for (int r : regs)
+        users[r].push_back(&in);
+    }
+  return users;
+}
+
+static std::vector<int> count_defs(IRFunction &fn)
+{
+  std::vector<int> defs(fn.vregs.size());
+  for (IRBlock &block : fn.blocks)
+    for (IRInsn &in : block.insns)
+      if (in.d >= 0)
+        defs[in.d]++;
+  return defs;
+}
+
+//
+// Within each block of the loop, a register that is only ever a copy
+// of another is replaced by that one where it is read before the other
+// changes, and the copy is dropped if that leaves it unread.
+//
+static void propagate_copies(IRFunction &fn, const Loop &l)
+{
+  std::vector<int> defs = count_defs(fn);
+  std::vector<int> regs;
+  for (int b = l.head; b <= l.tail; b++) {
+    std::vector<IRInsn> &insns = fn.blocks[b].insns;
+    for (size_t i = 0; i < insns.size(); i++) {
+      if (insns[i].op != IR_MOVE || defs[insns[i].d] != 1)
+        continue;
+      int copy = insns[i].d, of = insns[i].a;
+      for (size_t j = i + 1; j < insns.size(); j++) {
+        IRInsn &in = insns[j];
+        for (int *r : {&in.a, &in.b})
+          if (*r == copy)
+            *r = of;
+        for (int &r : in.args)
+          if (r == copy)
+            r = of;
+        if (in.d == of)
+          break;
+      }
+    }
+  }
+  std::vector<std::vector<IRInsn *> > users = find_uses(fn);
+  for (int b = l.head; b <= l.tail; b++) {
+    std::vector<IRInsn> &insns = fn.blocks[b].insns;
+    insns.erase(std::remove_if(insns.begin(), insns.end(),
+                               [&](const IRInsn &in) {
+                                 return in.op == IR_MOVE && defs[in.d] == 1 && users[in.d].empty();
+                               }),
+                insns.end());
+  }
+}
+
+//
+// Keeps word slot of self in a register over the loop if the loop
+// only unboxes what it loads from the slot and only stores new boxes
+// of Ints there, and nothing else in it may write or read the slot.
+//
+static bool promote_attr(IRFunction &fn, const Loop &l, int slot)
+{
+  std::vector<std::vector<IRInsn *> > users = find_uses(fn);
+  std::vector<int> defs = count_defs(fn);
+  std::vector<const IRInsn *> def_insn(fn.vregs.size(), NULL);
+  for (int b = l.head; b <= l.tail; b++)
+    for (const IRInsn &in : fn.blocks[b].insns)
+      if (in.d >= 0)
+        def_insn[in.d] = &in;
+
+  auto in_loop = [&](const IRInsn *use) {
+    for (int b = l.head; b <= l.tail; b++)
+      for (const IRInsn &in : fn.blocks[b].insns)
+        if (&in == use)
+          return true;
+    return false;
+  };
+
+  bool stored = false;
+  for (int b = l.head; b <= l.tail; b++)
+    for (const IRInsn &in : fn.blocks[b].insns) {
+      if (in.op != IR_LOAD && in.op != IR_STORE && may_store(in))
+        return false;
+      if ((in.op != IR_LOAD && in.op != IR_STORE) || in.imm != slot)
+        continue;
+      if (in.a != 0)
+        return false;
+      if (in.op == IR_STORE) {
+        const IRInsn *box = def_insn[in.b];
+        if (defs[in.b] != 1 || box == NULL || box->op != IR_BOX_INT)
+          return false;
+        stored = true;
+      } else {
+        for (const IRInsn *use : users[in.d])
+          if (use->op != IR_UNBOX || !in_loop(use))
+            return false;
+        if (defs[in.d] != 1)
+          return false;
+      }
+    }
+  if (!stored)
+    return false;
+
+  // every way out goes to a block only the loop goes to
+  std::vector<int> exits;
+  for (int b = l.head; b <= l.tail; b++)
+    for (int succ : fn.blocks[b].insns.back().successors())
+      if (!l.contains(succ) && std::find(exits.begin(), exits.end(), succ) == exits.end())
+        exits.push_back(succ);
+  for (size_t b = 0; b < fn.blocks.size(); b++)
+    for (int succ : fn.blocks[b].insns.back().successors())
+      if (!l.contains(b) && std::find(exits.begin(), exits.end(), succ) != exits.end())
+        return false;
+
+  int word = fn.new_vreg(IR_WORD);
+  users.resize(fn.vregs.size());
+  defs.resize(fn.vregs.size());
+  for (int b = l.head; b <= l.tail; b++)
+    for (IRInsn &in : fn.blocks[b].insns) {
+      if ((in.op != IR_LOAD && in.op != IR_STORE) || in.imm != slot)
+        continue;
+      if (in.op == IR_LOAD) {
+        // its unboxes read the register instead
+        for (IRInsn *use : users[in.d]) {
+          use->op = IR_MOVE;
+          use->a = word;
+        }
+        in.op = IR_MOVE;        // dead; dropped below
+        in.a = -1;
+      } else {
+        int box = in.b, value = def_insn[box]->a;
+        in = IRInsn(IR_MOVE);
+        in.d = word;
+        in.a = value;
+        // an unbox of the new box is its value, if that is not reassigned
+        if (defs[value] == 1)
+          for (IRInsn *use : users[box])
+            if (use->op == IR_UNBOX) {
+              use->op = IR_MOVE;
+              use->a = value;
+            }
+      }
+    }
+
+  // and the boxes that were only stored are not needed
+  for (int b = l.head; b <= l.tail; b++) {
+    std::vector<IRInsn> &insns = fn.blocks[b].insns;
+    insns.erase(std::remove_if(insns.begin(), insns.end(),
+                               [](const IRInsn &in) { return in.op == IR_MOVE && in.a < 0; }),
+                insns.end());
+  }
+  users = find_uses(fn);
+  for (int b = l.head; b <= l.tail; b++) {
+    std::vector<IRInsn> &insns = fn.blocks[b].insns;
+    insns.erase(std::remove_if(insns.begin(), insns.end(),
+                               [&](const IRInsn &in) {
+                                 return in.op == IR_BOX_INT && users[in.d].empty();
+                               }),
+                insns.end());
+  }
+
+  IRInsn load(IR_LOAD);
+  load.d = fn.new_vreg(IR_OBJ);
+  load.a = 0;
+  load.imm = slot;
+  insert_at_end(fn, l.preheader, load);
+  IRInsn unbox(IR_UNBOX);
+  unbox.d = word;
+  unbox.a = load.d;
+  insert_at_end(fn, l.preheader, unbox);
+
+  for (int e : exits) {
+    IRInsn box(IR_BOX_INT);
+    box.d = fn.new_vreg(IR_OBJ);
+    box.a = word;
+    IRInsn store(IR_STORE);
+    store.a = 0;
+    store.b = box.d;
+    store.imm = slot;
+    std::vector<IRInsn> &insns = fn.blocks[e].insns;
+    insns.insert(insns.begin(), store);
+    insns.insert(insns.begin(), box);
+  }
+  propagate_copies(fn, l);
+  return true;
+}
+
+//
+// An instruction can be hoisted if it has no effect and its operands
+// are defined outside the loop or by instructions already hoisted.
+// Arithmetic may trap on overflow, so it is only taken from the test,
+// which runs whenever the preheader does.  Loads are from self, which
+// is never void, of slots nothing in the loop may write.
+//
+static int hoist_invariants(IRFunction &fn, const Loop &l)
+{
+  std::vector<int> defs = count_defs(fn), loop_defs(fn.vregs.size());
+  std::vector<bool> written;
+  bool calls = false;
+  for (int b = l.head; b <= l.tail; b++)
+    for (const IRInsn &in : fn.blocks[b].insns) {
+      if (in.d >= 0)
+        loop_defs[in.d]++;
+      if (in.op == IR_STORE) {
+        if (in.imm >= int(written.size()))
+          written.resize(in.imm + 1);
+        written[in.imm] = true;
+      } else if (may_store(in)) {
+        calls = true;
+      }
+    }
+
+  int hoisted = 0;
+  std::vector<int> regs;
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (int b = l.head; b <= l.tail; b++) {
+      std::vector<IRInsn> &insns = fn.blocks[b].insns;
+      for (size_t i = 0; i + 1 < insns.size(); i++) {
+        const IRInsn &in = insns[i];
+        bool pure;
+        switch (in.op) {
+        case IR_UNBOX:
+        case IR_LT:
+        case IR_LE:
+        case IR_EQ:
+        case IR_NOT:
+        case IR_ISVOID:
+        case IR_BOX_BOOL:
+          pure = true;
+          break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_NEG:
+          pure = b == l.head;
+          break;
+        case IR_LOAD:
+          pure = in.a == 0 && !calls && (in.imm >= int(written.size()) || !written[in.imm]);
+          break;
+        default:
+          pure = false;
+        }
+        if (!pure || defs[in.d] != 1)
+          continue;
+        in.uses(regs);
+        if (std::any_of(regs.begin(), regs.end(), [&](int r) { return loop_defs[r] > 0; }))
+          continue;
+
+        loop_defs[in.d] = 0;
+        insert_at_end(fn, l.preheader, in);
+        insns.erase(insns.begin() + i--);
+        hoisted++;
+        changed = true;
+      }
+    }
+  }
+  return hoisted;
+}
+
+void optimize_loops(IRFunction &fn, int &hoisted, int &promoted)
+{
+  for (const Loop &l : find_loops(fn)) {
+    std::vector<int> slots;
+    for (int b = l.head; b <= l.tail; b++)
+      for (const IRInsn &in : fn.blocks[b].insns)
+        if (in.op == IR_STORE && in.a == 0 &&
+            std::find(slots.begin(), slots.end(), in.imm) == slots.end())
+          slots.push_back(in.imm);
+    for (int slot : slots)
+      if (promote_attr(fn, l, slot))
+        promoted++;
+    hoisted += hoist_invariants(fn, l);
+  }
+}
+
+//
+// Live ranges are single intervals over the instructions numbered in
+// block order: a register is live from its first definition or use to
+// its last, extended over every block it is live into or out of.
+//
+struct Interval
+{
+  int vreg;
+  int start, end;
+  bool crosses_call;
+  long weight;
+};
+
+static void compute_liveness(IRFunction &fn,
+                             std::vector<std::vector<bool> > &live_in,
+                             std::vector<std::vector<bool> > &live_out)
+{
+  size_t nblocks = fn.blocks.size(), nregs = fn.vregs.size();
+  std::vector<std::vector<bool> > use(nblocks, std::vector<bool>(nregs)),
+                                  def(nblocks, std::vector<bool>(nregs));
+  std::vector<int> regs;
+
+  for (size_t b = 0; b < nblocks; b++)
+    for (const IRInsn &in : fn.blocks[b].insns) {
+      in.uses(regs);
+      for (int r : regs)
+        if (!def[b][r])
+          use[b][r] = true;
+      if (in.d >= 0)
+        def[b][in.d] = true;
+    }
+
+  live_in.assign(nblocks, std::vector<bool>(nregs));
+  live_out.assign(nblocks, std::vector<bool>(nregs));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = nblocks; b-- > 0;) {
+      std::vector<bool> out(nregs);
+      for (int succ : fn.blocks[b].insns.back().successors())
+        for (size_t r = 0; r < nregs; r++)
+          if (live_in[succ][r])
+            out[r] = true;
+      std::vector<bool> in = use[b];
+      for (size_t r = 0; r < nregs; r++)
+        if (out[r] && !def[b][r])
+          in[r] = true;
+      if (in != live_in[b] || out != live_out[b]) {
+        live_in[b] = in;
+        live_out[b] = out;
+        changed = true;
+      }
+    }
+  }
+}
+
+static void allocate(IRFunction &fn, int caller_regs, int callee_regs, bool words_on_stack,
+                     IRAlloc &alloc)
+{
+  size_t nregs = fn.vregs.size();
+  std::vector<int> defs(nregs, 0), arg_of(nregs, -1);
+  std::vector<const IRInsn *> def_insn(nregs, NULL);
+  std::vector<int> regs;
+
+  alloc.homes.assign(nregs, IRHome());
+  alloc.use_count.assign(nregs, 0);
+  alloc.const_def.assign(nregs, NULL);
+  alloc.callee_used = 0;
+  alloc.slots = 0;
+
+  for (IRBlock &block : fn.blocks)
+    for (IRInsn &in : block.insns) {
+      in.uses(regs);
+      for (int r : regs)
+        alloc.use_count[r]++;
+      if (in.d >= 0) {
+        defs[in.d]++;
+        def_insn[in.d] = &in;
+        if (in.op == IR_ARG)
+          arg_of[in.d] = in.imm;
+      }
+    }
+
+  alloc.homes[0].kind = HOME_SELF;
+  for (size_t v = 1; v < nregs; v++)
+    if (defs[v] == 1 && (def_insn[v]->op == IR_LI || def_insn[v]->op == IR_LA)) {
+      alloc.homes[v].kind = HOME_CONST;
+      alloc.const_def[v] = def_insn[v];
+    }
+
+  std::vector<std::vector<bool> > live_in, live_out;
+  compute_liveness(fn, live_in, live_out);
+
+  // number the instructions and build the intervals
+  std::vector<Interval> intervals(nregs);
+  for (size_t v = 0; v < nregs; v++) {
+    intervals[v].vreg = v;
+    intervals[v].start = INT_MAX;
+    intervals[v].end = -1;
+    intervals[v].crosses_call = false;
+    intervals[v].weight = 0;
+  }
+  auto extend = [&](int v, int pos) {
+    intervals[v].start = std::min(intervals[v].start, pos);
+    intervals[v].end = std::max(intervals[v].end, pos);
+  };
+
+  std::vector<int> calls;
+  int pos = 0;
+  for (size_t b = 0; b < fn.blocks.size(); b++) {
+    IRBlock &block = fn.blocks[b];
+    int first = pos;
+    int last = pos + block.insns.size() - 1;
+    long weight = 1;
+    for (int i = 0; i < std::min(block.depth, 4); i++)
+      weight *= 8;
+    for (size_t v = 0; v < nregs; v++) {
+      if (live_in[b][v])
+        extend(v, first);
+      if (live_out[b][v])
+        extend(v, last);
+    }
+    for (IRInsn &in : block.insns) {
+      in.uses(regs);
+      for (int r : regs) {
+        extend(r, pos);
+        intervals[r].weight += weight;
+      }
+      if (in.d >= 0) {
+        extend(in.d, pos);
+        intervals[in.d].weight += weight;
+      }
+      if (in.is_call())
+        calls.push_back(pos);
+      // an Int is boxed by allocating the box first; without the stack,
+      // the back end keeps the word somewhere else meanwhile
+      if (in.op == IR_BOX_INT && words_on_stack)
+        intervals[in.a].crosses_call = true;
+      pos++;
+    }
+  }
+  for (Interval &iv : intervals)
+    for (int call : calls)
+      if (iv.start < call && call < iv.end)
+        iv.crosses_call = true;
+
+  // linear scan
+  std::vector<Interval *> order;
+  for (size_t v = 1; v < nregs; v++)
+    if (alloc.homes[v].kind == HOME_NONE && intervals[v].end >= 0)
+      order.push_back(&intervals[v]);
+  std::stable_sort(order.begin(), order.end(),
+                   [](Interval *x, Interval *y) { return x->start < y->start; });
+
+  std::vector<int> caller_owner(caller_regs, -1), callee_owner(callee_regs, -1);
+  auto spill = [&](int v) {
+    if (arg_of[v] >= 0) {
+      alloc.homes[v].kind = HOME_ARG;
+      alloc.homes[v].index = arg_of[v];
+    } else {
+      alloc.homes[v].kind = HOME_SLOT;   // numbered below
+    }
+  };
+  auto take = [&](int v, IRHomeKind kind, int r) {
+    alloc.homes[v].kind = kind;
+    alloc.homes[v].index = r;
+    (kind == HOME_CALLER ? caller_owner : callee_owner)[r] = v;
+    if (kind == HOME_CALLEE)
+      alloc.callee_used = std::max(alloc.callee_used, r + 1);
+  };
+
+  for (Interval *iv : order) {
+    int v = iv->vreg;
+    for (int &owner : caller_owner)
+      if (owner >= 0 && intervals[owner].end < iv->start)
+        owner = -1;
+    for (int &owner : callee_owner)
+      if (owner >= 0 && intervals[owner].end < iv->start)
+        owner = -1;
+
+    // A caller-saved register is free to use; a callee-saved one has
+    // to be saved and restored once per call of the function, which
+    // only pays if the value is used more than twice.
+    int r = -1;
+    if (!iv->crosses_call)
+      for (r = 0; r < caller_regs && caller_owner[r] >= 0; r++)
+        ;
+    if (r >= 0 && r < caller_regs) {
+      take(v, HOME_CALLER, r);
+      continue;
+    }
+    for (r = 0; r < callee_regs && callee_owner[r] >= 0; r++)
+      ;
+    if (r < callee_regs && (r < alloc.callee_used || iv->weight > 2)) {
+      take(v, HOME_CALLEE, r);
+      continue;
+    }
+
+    // take the register of the lightest live value if it is lighter,
+    // or of any object for a word that may not go on the stack
+    bool word = !words_on_stack && fn.vregs[v] == IR_WORD;
+    auto lighter = [&](int owner, int than) {
+      return owner >= 0 && (!word || fn.vregs[owner] == IR_OBJ) &&
+             (than < 0 || intervals[owner].weight < intervals[than].weight);
+    };
+    int victim = -1;
+    IRHomeKind victim_kind = HOME_NONE;
+    if (!iv->crosses_call)
+      for (int owner : caller_owner)
+        if (lighter(owner, victim)) {
+          victim = owner;
+          victim_kind = HOME_CALLER;
+        }
+    for (int owner : callee_owner)
+      if (lighter(owner, victim)) {
+        victim = owner;
+        victim_kind = HOME_CALLEE;
+      }
+    if (victim >= 0 && (word || intervals[victim].weight < iv->weight)) {
+      int reg = alloc.homes[victim].index;
+      spill(victim);
+      (victim_kind == HOME_CALLER ? caller_owner : callee_owner)[reg] = -1;
+      take(v, victim_kind, reg);
+    } else {
+      spill(v);
+    }
+  }
+
+  // A value keeps its home for the whole of its interval, so values
+  // whose intervals don't overlap, such as the variables of lets and
+  // case branches in turn, share a slot.  Words and objects never
+  // share one, so a slot that ever holds an object holds only objects.
+  // The frame is as big as the most slots in use at once.
+  std::vector<Interval *> spilled;
+  for (Interval *iv : order)
+    if (alloc.homes[iv->vreg].kind == HOME_SLOT)
+      spilled.push_back(iv);
+  std::vector<int> slot_owner;
+  for (Interval *iv : spilled) {
+    size_t slot = 0;
+    while (slot < slot_owner.size() &&
+           (intervals[slot_owner[slot]].end >= iv->start ||
+            fn.vregs[slot_owner[slot]] != fn.vregs[iv->vreg]))
+      slot++;
+    if (slot == slot_owner.size())
+      slot_owner.push_back(-1);
+    slot_owner[slot] = iv->vreg;
+    alloc.homes[iv->vreg].index = slot;
+  }
+  alloc.slots = slot_owner.size();
+}
+
+//
+// Makes each word that got a stack slot an object instead: every
+// definition of it boxes the value as an Int, and every use unboxes
+// it.  The box never escapes, so an unboxed Bool is boxed the same
+// way.  Returns whether there were any.
+//
+static bool box_spilled_words(IRFunction &fn, const IRAlloc &alloc)
+{
+  std::vector<bool> boxed(fn.vregs.size());
+  bool any = false;
+  for (size_t v = 1; v < fn.vregs.size(); v++)
+    if (fn.vregs[v] == IR_WORD && alloc.homes[v].kind == HOME_SLOT) {
+      boxed[v] = any = true;
+      fn.vregs[v] = IR_OBJ;
+    }
+  if (!any)
+    return false;
+
+  for (IRBlock &block : fn.blocks) {
+    std::vector<IRInsn> insns;
+    for (IRInsn in : block.insns) {
+      // the arguments of a dispatch are objects already
+      for (int *r : {&in.a, &in.b})
+        if (*r >= 0 && boxed[*r]) {
+          IRInsn unbox(IR_UNBOX);
+          unbox.d = fn.new_vreg(IR_WORD);
+          unbox.a = *r;
+          unbox.line = in.line;
+          insns.push_back(unbox);
+          *r = unbox.d;
+        }
+      int d = in.d;
+      if (d >= 0 && boxed[d])
+        in.d = fn.new_vreg(IR_WORD);
+      insns.push_back(in);
+      if (d >= 0 && boxed[d]) {
+        IRInsn box(IR_BOX_INT);
+        box.d = d;
+        box.a = in.d;
+        box.line = in.line;
+        insns.push_back(box);
+      }
+    }
+    block.insns.swap(insns);
+  }
+  return true;
+}
+
+void allocate_registers(IRFunction &fn, int caller_regs, int callee_regs, bool words_on_stack,
+                        IRAlloc &alloc)
+{
+  do
+    allocate(fn, caller_regs, callee_regs, words_on_stack, alloc);
+  while (!words_on_stack && box_spilled_words(fn, alloc));
+}
@@ -0,0 +1,182 @@
+#ifndef IR_H
+#define IR_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Three-address intermediate code
+//
+//  Method bodies and class init routines are translated from the AST
+//  into an IRFunction, which a back end then lowers to its own output.
+//  A function is a list of basic blocks, each a list of instructions
+//  ending in a jump, a branch, a return or an abort.  Instructions
+//  read and write virtual registers, as many as needed.  A virtual
+//  register holds either an object pointer or a raw word (an unboxed
+//  Int or Bool); boxing and unboxing are explicit instructions.
+//
+//  Virtual register 0 is self.  It is never assigned.
+//
+//////////////////////////////////////////////////////////////////////
+
+enum IRType { IR_OBJ, IR_WORD };
+
+enum IROp
+{
+  // d = ...
+  IR_LI,                // the word imm (0 is also void)
+  IR_LA,                // the address of label: a constant object or prototype
+  IR_MOVE,              // a
+  IR_ARG,               // argument imm of the method, counting from 0
+  IR_ADD, IR_SUB, IR_MUL, IR_DIV,   // a op b, on words
+  IR_LT, IR_LE, IR_EQ,  // a op b, on words: 1 or 0
+  IR_NEG,               // -a
+  IR_NOT,               // a xor 1
+  IR_ISVOID,            // 1 if object a is void, else 0
+  IR_LOAD,              // word imm of object a, of class label if not the one coded
+  IR_UNBOX,             // the value of Int or Bool object a
+  IR_BOX_INT,           // a new Int holding a
+  IR_BOX_BOOL,          // the Bool constant for a
+  IR_NEW,               // a new object of class label, of imm words, initialized
+  IR_NEW_PROTO,         // as IR_NEW, for a class with a trivial init routine
+  IR_NEW_SELF,          // a new object of self's class, initialized
+  IR_DISPATCH,          // method label of a, dispatch slot imm, with args
+  IR_STATIC_DISPATCH,   // method label ("Class.method") of a, with args
+  IR_OBJ_EQ,            // 1 if objects a and b are equal, else 0
+
+  // no result
+  IR_STORE,             // word imm of object a = b, as for IR_LOAD
+  IR_INIT,              // run init routine label on object a
+  IR_PRINT_INT,         // print the word a (IO.out_int); b is the receiver
+  IR_CHECK_VOID,        // abort a dispatch on void if object a is void
+
+  // terminators
+  IR_JUMP,              // to block target
+  IR_BRANCH,            // to block target if a != 0, else to block other
+  IR_SWITCH,            // to block table[a - imm] if there is one, else to block other
+  IR_RETURN,            // a
+  IR_ABORT_CASE_VOID,   // case on void
+  IR_ABORT_CASE,        // no branch of a case matches object a
+};
+
+struct IRInsn
+{
+  IROp op;
+  int d, a, b;            // virtual registers, -1 if unused
+  int imm;
+  int line;               // source line, for run-time errors
+  std::string label;
+  std::vector<int> args;  // arguments of a dispatch, first to last
+  int target, other;      // successor blocks
+  std::vector<int> table; // successor blocks of a switch
+  bool tail;              // a dispatch whose result the return after it returns
+
+  IRInsn(IROp o)
+    : op(o), d(-1), a(-1), b(-1), imm(0), line(0), target(-1), other(-1), tail(false) {}
+
+  bool is_terminator() const { return op >= IR_JUMP; }
+  bool is_call() const;
+  void uses(std::vector<int> &regs) const;
+  std::vector<int> successors() const;
+};
+
+struct IRBlock
+{
+  std::vector<IRInsn> insns;
+  int depth;              // loop nesting
+};
+
+struct IRFunction
+{
+  std::string name;
+  int nargs;
+  int line;
+  std::vector<IRBlock> blocks;   // blocks[0] is the entry
+  std::vector<IRType> vregs;
+
+  IRFunction(const std::string &n, int na, int l) : name(n), nargs(na), line(l)
+  {
+    vregs.push_back(IR_OBJ);     // self
+  }
+
+  int new_vreg(IRType t) { vregs.push_back(t); return vregs.size() - 1; }
+  void print(std::ostream &s, const char *prefix);
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Tail calls
+//
+//  mark_tail_calls finds the dispatches whose result the function
+//  returns straight away, either in the same block or by way of a move
+//  and a jump to a block that only returns, and gives each block its
+//  own return so that the call is followed by it.  A back end lowers
+//  such a call, with the return, to a jump that reuses the caller's
+//  frame.  Returns the number of calls it marked.
+//
+//////////////////////////////////////////////////////////////////////
+
+int mark_tail_calls(IRFunction &fn);
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Loops
+//
+//  optimize_loops works on each while loop of a function, innermost
+//  first.  An Int attribute of self that the loop counts with (loads,
+//  unboxes, and stores only as a new box) is kept unboxed in a
+//  register for the loop's duration, loaded before it and stored back
+//  on the way out.  Then the instructions that compute the same value
+//  on every iteration are hoisted out in front of it: loads of self's
+//  attributes the loop cannot write, unboxing, comparisons, and, from
+//  the loop's test, arithmetic.  Adds the number of each to hoisted
+//  and promoted.
+//
+//////////////////////////////////////////////////////////////////////
+
+void optimize_loops(IRFunction &fn, int &hoisted, int &promoted);
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Register allocation
+//
+//  allocate_registers gives every virtual register of a function a
+//  home: a register of the back end's caller-saved pool (lost across
+//  calls), one of its callee-saved pool (saved in the prologue), a
+//  stack slot, which values of the same kind (words or objects) share
+//  when they are not live at the same time, or nothing for constants,
+//  which are rematerialized where they are used.  Formal parameters
+//  that don't get a register stay in their argument slot.
+//
+//  Without words_on_stack, no raw word is given a stack slot, for a
+//  back end whose collector takes any word on the stack that looks
+//  like a heap address for a pointer.  A word that would need one is
+//  kept boxed instead, and the back end has to box an Int without
+//  keeping the word on the stack across the allocation.
+//
+//////////////////////////////////////////////////////////////////////
+
+enum IRHomeKind { HOME_NONE, HOME_SELF, HOME_CONST, HOME_CALLER, HOME_CALLEE, HOME_SLOT, HOME_ARG };
+
+struct IRHome
+{
+  IRHomeKind kind;
+  int index;              // register, slot or argument number
+  IRHome() : kind(HOME_NONE), index(0) {}
+};
+
+struct IRAlloc
+{
+  std::vector<IRHome> homes;
+  std::vector<int> use_count;
+  std::vector<const IRInsn *> const_def;  // the IR_LI or IR_LA of a constant
+  int callee_used;        // callee-saved registers 0..callee_used-1 are used
+  int slots;              // stack slots used
+};
+
+void allocate_registers(IRFunction &fn, int caller_regs, int callee_regs, bool words_on_stack,
+                        IRAlloc &alloc);
+
+#endif
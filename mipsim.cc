@@ -0,0 +1,1130 @@
+//**************************************************************
+//
+// MIPS simulator
+//
+// mipsim runs the SPIM code that cgen produces without a SPIM
+// install, and reports what the run cost:
+//
+//    ./mycoolc prog.cl
+//    ./mipsim prog.s < input
+//
+// The program's output goes to stdout and the counters to stderr:
+// instructions retired, loads, stores, taken branches and jumps,
+// calls, and the objects and bytes allocated.  Every instruction
+// of the assembly counts as one, pseudo-instructions included, so
+// the count is that of the code cgen wrote rather than of what
+// SPIM would expand it to.
+//
+// The COOL runtime of trap.handler is built in.  Its routines
+// (Object.copy, IO.out_string, equality_test, _dispatch_abort, the
+// GC entry points, ...) have addresses of their own below the text
+// segment, and a jump to one of them runs it natively and returns
+// to $ra, following the same conventions as the trap handler.  The
+// heap is never collected.  As in the trap handler, $gp points to its
+// next free word and $s7 to its end, so that the generated code can
+// allocate by bumping $gp; the heap grows when the runtime allocates
+// past $s7.  A write that moves $gp up counts as an allocation.  The
+// other GC entry points do nothing.
+//
+// When the program selects a collector (cgen -g), every allocation by
+// the runtime first checks the stack as the collector would find it: a
+// word there that points into the heap but not at an object, such as
+// an Int that happens to have a heap address as its value, stops the
+// run, since the collector would take it for a pointer and move or
+// overwrite what it points at.
+// Execution starts at __start, which is assembled along with the
+// program from the prelude below.
+//
+//**************************************************************
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Memory layout
+#define NATIVE_BASE  0x00100000
+#define TEXT_BASE    0x00400000
+#define DATA_BASE    0x10000000
+#define STACK_TOP    0x7fffeffc     // where $sp starts, as in SPIM
+#define STACK_END    0x80000000
+#define STACK_SIZE   (16 << 20)
+#define HEAP_CHUNK   (1 << 20)     // by how much the heap grows at least
+
+// Registers the runtime uses
+#define R_ZERO 0
+#define R_V0   2
+#define R_A0   4
+#define R_A1   5
+#define R_T1   9
+#define R_T2   10
+#define R_S7   23
+#define R_GP   28
+#define R_SP   29
+#define R_RA   31
+
+// Object layout, in words
+#define TAG_OFFSET        0
+#define SIZE_OFFSET       1
+#define DISPTABLE_OFFSET  2
+#define DEFAULT_OBJFIELDS 3
+
+//
+// What trap.handler does before and after the program: set up the
+// memory manager, make a Main object, initialize it, call main and
+// exit.
+//
+static const char *prelude = R"(
+	.data
+_term_msg:
+	.ascii	"\nCOOL program successfully executed\n"
+	.byte	0
+	.text
+__start:
+	la	$t0 _MemMgr_INITIALIZER
+	lw	$t0 0($t0)
+	move	$a0 $sp
+	jalr	$t0
+	la	$a0 Main_protObj
+	jal	Object.copy
+	addiu	$sp $sp -4
+	sw	$a0 4($sp)
+	move	$s0 $a0
+	jal	Main_init
+	jal	Main.main
+	addiu	$sp $sp 4
+	la	$a0 _term_msg
+	li	$v0 4
+	syscall
+	li	$v0 10
+	syscall
+)";
+
+enum Op {
+  OP_LW, OP_SW, OP_LB, OP_SB, OP_LA, OP_LI, OP_MOVE,
+  OP_ADD, OP_ADDU, OP_SUB, OP_SUBU, OP_MUL, OP_DIV, OP_REM,
+  OP_AND, OP_OR, OP_XOR, OP_NOR, OP_SLLV, OP_SRLV, OP_SRAV,
+  OP_SLT, OP_SLTU, OP_SLE, OP_SGT, OP_SGE, OP_SEQ, OP_SNE,
+  OP_ADDI, OP_ADDIU, OP_ANDI, OP_ORI, OP_XORI, OP_SLTI, OP_SLTIU, OP_LUI,
+  OP_SLL, OP_SRL, OP_SRA, OP_NEG, OP_NEGU, OP_NOT,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BLE, OP_BGT, OP_BGE,
+  OP_BEQZ, OP_BNEZ, OP_BLTZ, OP_BLEZ, OP_BGTZ, OP_BGEZ,
+  OP_B, OP_J, OP_JAL, OP_JR, OP_JALR, OP_SYSCALL, OP_NOP,
+};
+
+// How an instruction's operands are written.
+enum Form {
+  F_MEM,        // rt, offset(rs)
+  F_ADDR,       // rd, label
+  F_IMM,        // rd, imm
+  F_RR,         // rd, rs
+  F_RRR,        // rd, rs, rt or imm
+  F_RRI,        // rd, rs, imm
+  F_BR2,        // rs, rt or imm, label
+  F_BR1,        // rs, label
+  F_LABEL,      // label
+  F_REG,        // rs
+  F_NONE,
+};
+
+struct OpInfo {
+  const char *name;
+  Op op;
+  Form form;
+};
+
+static const OpInfo op_infos[] = {
+  {"lw", OP_LW, F_MEM}, {"sw", OP_SW, F_MEM}, {"lb", OP_LB, F_MEM}, {"sb", OP_SB, F_MEM},
+  {"la", OP_LA, F_ADDR}, {"li", OP_LI, F_IMM}, {"lui", OP_LUI, F_IMM}, {"move", OP_MOVE, F_RR},
+  {"add", OP_ADD, F_RRR}, {"addu", OP_ADDU, F_RRR}, {"sub", OP_SUB, F_RRR},
+  {"subu", OP_SUBU, F_RRR}, {"mul", OP_MUL, F_RRR}, {"div", OP_DIV, F_RRR},
+  {"rem", OP_REM, F_RRR}, {"and", OP_AND, F_RRR}, {"or", OP_OR, F_RRR},
+  {"xor", OP_XOR, F_RRR}, {"nor", OP_NOR, F_RRR}, {"sllv", OP_SLLV, F_RRR},
+  {"srlv", OP_SRLV, F_RRR}, {"srav", OP_SRAV, F_RRR}, {"slt", OP_SLT, F_RRR},
+  {"sltu", OP_SLTU, F_RRR}, {"sle", OP_SLE, F_RRR}, {"sgt", OP_SGT, F_RRR},
+  {"sge", OP_SGE, F_RRR}, {"seq", OP_SEQ, F_RRR}, {"sne", OP_SNE, F_RRR},
+  {"addi", OP_ADDI, F_RRI}, {"addiu", OP_ADDIU, F_RRI}, {"andi", OP_ANDI, F_RRI},
+  {"ori", OP_ORI, F_RRI}, {"xori", OP_XORI, F_RRI}, {"slti", OP_SLTI, F_RRI},
+  {"sltiu", OP_SLTIU, F_RRI}, {"sll", OP_SLL, F_RRI}, {"srl", OP_SRL, F_RRI},
+  {"sra", OP_SRA, F_RRI}, {"neg", OP_NEG, F_RR}, {"negu", OP_NEGU, F_RR},
+  {"not", OP_NOT, F_RR},
+  {"beq", OP_BEQ, F_BR2}, {"bne", OP_BNE, F_BR2}, {"blt", OP_BLT, F_BR2},
+  {"ble", OP_BLE, F_BR2}, {"bgt", OP_BGT, F_BR2}, {"bge", OP_BGE, F_BR2},
+  {"beqz", OP_BEQZ, F_BR1}, {"bnez", OP_BNEZ, F_BR1}, {"bltz", OP_BLTZ, F_BR1},
+  {"blez", OP_BLEZ, F_BR1}, {"bgtz", OP_BGTZ, F_BR1}, {"bgez", OP_BGEZ, F_BR1},
+  {"b", OP_B, F_LABEL}, {"j", OP_J, F_LABEL}, {"jal", OP_JAL, F_LABEL},
+  {"jr", OP_JR, F_REG}, {"jalr", OP_JALR, F_REG},
+  {"syscall", OP_SYSCALL, F_NONE}, {"nop", OP_NOP, F_NONE},
+};
+
+static const char *reg_names[32] = {
+  "zero", "at", "v0", "v1", "a0", "a1", "a2", "a3",
+  "t0", "t1", "t2", "t3", "t4", "t5", "t6", "t7",
+  "s0", "s1", "s2", "s3", "s4", "s5", "s6", "s7",
+  "t8", "t9", "k0", "k1", "gp", "sp", "fp", "ra",
+};
+
+struct Insn {
+  Op op;
+  int rd, rs, rt;          // rt < 0: the second operand is imm
+  int32_t imm;
+  std::string label;       // resolved into target, or imm for la
+  uint32_t target;
+  int line;
+};
+
+class Simulator;
+typedef void (Simulator::*Native)();
+
+class Simulator
+{
+private:
+  std::vector<Insn> text;
+  std::vector<uint8_t> data;           // the data segment, then the heap
+  uint32_t heap_start;
+  bool check_roots;                    // whether the program has a collector
+  std::vector<uint8_t> stack;
+  std::map<std::string, uint32_t> symbols;
+  std::vector<std::pair<uint32_t, std::string> > data_fixups;
+  std::vector<Native> natives;
+  std::vector<std::string> native_names;
+  std::string filename;
+  int line;
+
+  int32_t regs[32];
+  uint32_t pc;
+
+  // counters
+  long long n_insns, n_loads, n_stores, n_jumps, n_calls, n_allocs, n_alloc_bytes;
+
+  // assembly
+  void error(const std::string &msg);
+  void assemble(std::istream &in, const std::string &name);
+  void assemble_line(std::string s, bool &in_text);
+  void directive(const std::string &name, const std::string &args, bool in_text);
+  void instruction(const std::string &name, const std::vector<std::string> &ops);
+  int parse_reg(const std::string &s);
+  bool parse_int(const std::string &s, int32_t &v);
+  void align_data(int bytes);
+  void add_native(const char *name, Native fn);
+  void resolve();
+
+  // execution
+  void fault(const char *msg);
+  uint8_t *addr(uint32_t a, int size);
+  int32_t load(uint32_t a);
+  void store(uint32_t a, int32_t v);
+  void step();
+  void syscall();
+  void finish(int status);
+
+  // the runtime
+  uint32_t symbol(const char *name);
+  uint32_t alloc(uint32_t bytes);
+  uint32_t copy(uint32_t obj);
+  int32_t arg(int k, int nargs);
+  std::string str_chars(uint32_t s);
+  uint32_t new_string(const std::string &chars);
+  uint32_t new_int(int32_t val);
+  std::string class_name(uint32_t obj);
+  std::string read_line(bool &eof);
+
+  void object_abort();
+  void object_type_name();
+  void object_copy();
+  void io_out_string();
+  void io_out_int();
+  void io_in_string();
+  void io_in_int();
+  void string_length();
+  void string_concat();
+  void string_substr();
+  void equality_test();
+  void dispatch_abort();
+  void case_abort();
+  void case_abort2();
+  void check_stack();
+  void gc_init();
+  void gc_init_collected();
+  void gc_nop();
+
+public:
+  Simulator();
+  void load_program(const char *path);
+  void run();
+};
+
+//////////////////////////////////////////////////////////////////////
+//
+// Assembly
+//
+// Two passes: the first lays out the text and data segments and
+// records the labels, the second resolves the labels used in
+// instructions and .word directives.
+//
+//////////////////////////////////////////////////////////////////////
+
+Simulator::Simulator() : heap_start(0), check_roots(false), line(0), pc(0), n_insns(0), n_loads(0), n_stores(0), n_jumps(0),
+                         n_calls(0), n_allocs(0), n_alloc_bytes(0)
+{
+  memset(regs, 0, sizeof(regs));
+  stack.assign(STACK_SIZE, 0);
+
+  add_native("Object.abort", &Simulator::object_abort);
+  add_native("Object.type_name", &Simulator::object_type_name);
+  add_native("Object.copy", &Simulator::object_copy);
+  add_native("IO.out_string", &Simulator::io_out_string);
+  add_native("IO.out_int", &Simulator::io_out_int);
+  add_native("IO.in_string", &Simulator::io_in_string);
+  add_native("IO.in_int", &Simulator::io_in_int);
+  add_native("String.length", &Simulator::string_length);
+  add_native("String.concat", &Simulator::string_concat);
+  add_native("String.substr", &Simulator::string_substr);
+  add_native("equality_test", &Simulator::equality_test);
+  add_native("_dispatch_abort", &Simulator::dispatch_abort);
+  add_native("_case_abort", &Simulator::case_abort);
+  add_native("_case_abort2", &Simulator::case_abort2);
+  add_native("_NoGC_Init", &Simulator::gc_init);
+  add_native("_GenGC_Init", &Simulator::gc_init_collected);
+  add_native("_ScnGC_Init", &Simulator::gc_init_collected);
+  const char *gc[] = {"_GenGC_Assign", "_gc_check", "_NoGC_Collect", "_GenGC_Collect",
+                      "_ScnGC_Collect"};
+  for (const char *name : gc)
+    add_native(name, &Simulator::gc_nop);
+}
+
+void Simulator::add_native(const char *name, Native fn)
+{
+  symbols[name] = NATIVE_BASE + 4 * natives.size();
+  natives.push_back(fn);
+  native_names.push_back(name);
+}
+
+void Simulator::error(const std::string &msg)
+{
+  std::cerr << filename << ":" << line << ": " << msg << std::endl;
+  exit(1);
+}
+
+void Simulator::load_program(const char *path)
+{
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "mipsim: cannot open " << path << std::endl;
+    exit(1);
+  }
+  std::istringstream pre(prelude);
+  assemble(pre, "<prelude>");
+  assemble(in, path);
+  resolve();
+}
+
+void Simulator::assemble(std::istream &in, const std::string &name)
+{
+  filename = name;
+  line = 0;
+  bool in_text = true;
+  std::string s;
+  while (std::getline(in, s)) {
+    line++;
+    assemble_line(s, in_text);
+  }
+}
+
+void Simulator::assemble_line(std::string s, bool &in_text)
+{
+  // strip the comment, minding '#' in strings
+  bool quoted = false;
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] == '"' && (i == 0 || s[i - 1] != '\\'))
+      quoted = !quoted;
+    else if (s[i] == '#' && !quoted) {
+      s.erase(i);
+      break;
+    }
+  }
+
+  // labels
+  for (;;) {
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos)
+      return;
+    size_t end = start;
+    while (end < s.size() && (isalnum((unsigned char)s[end]) || s[end] == '_' ||
+                              s[end] == '.' || s[end] == '$'))
+      end++;
+    if (end == start || end >= s.size() || s[end] != ':')
+      break;
+    std::string label = s.substr(start, end - start);
+    if (symbols.count(label))
+      error("label " + label + " defined twice");
+    symbols[label] = in_text ? TEXT_BASE + 4 * text.size() : DATA_BASE + data.size();
+    s.erase(0, end + 1);
+  }
+
+  size_t start = s.find_first_not_of(" \t");
+  size_t end = s.find_first_of(" \t", start);
+  std::string name = s.substr(start, end - start);
+  std::string rest = end == std::string::npos ? "" : s.substr(end);
+
+  if (name[0] == '.') {
+    if (name == ".text")
+      in_text = true;
+    else if (name == ".data")
+      in_text = false;
+    else
+      directive(name, rest, in_text);
+    return;
+  }
+  if (!in_text)
+    error("instruction in the data segment");
+
+  std::vector<std::string> ops;
+  for (char &c : rest)
+    if (c == ',')
+      c = ' ';
+  std::istringstream ss(rest);
+  std::string op;
+  while (ss >> op)
+    ops.push_back(op);
+  instruction(name, ops);
+}
+
+void Simulator::align_data(int bytes)
+{
+  while (data.size() % bytes)
+    data.push_back(0);
+}
+
+void Simulator::directive(const std::string &name, const std::string &args, bool in_text)
+{
+  if (name == ".globl" || name == ".ent" || name == ".end")
+    return;
+  if (in_text) {
+    if (name == ".align")
+      return;
+    error("directive " + name + " in the text segment");
+  }
+
+  std::istringstream ss(args);
+  std::string arg;
+  if (name == ".align") {
+    int n;
+    ss >> n;
+    align_data(1 << n);
+  } else if (name == ".word") {
+    align_data(4);
+    while (ss >> arg) {
+      if (arg.back() == ',')
+        arg.pop_back();
+      int32_t v;
+      if (!parse_int(arg, v)) {
+        data_fixups.push_back(std::make_pair(DATA_BASE + data.size(), arg));
+        v = 0;
+      }
+      for (int i = 0; i < 4; i++)
+        data.push_back((uint32_t)v >> (8 * i));
+    }
+  } else if (name == ".byte") {
+    while (ss >> arg) {
+      int32_t v;
+      if (!parse_int(arg, v))
+        error("bad byte " + arg);
+      data.push_back(v);
+    }
+  } else if (name == ".space") {
+    int n;
+    ss >> n;
+    data.insert(data.end(), n, 0);
+  } else if (name == ".ascii" || name == ".asciiz") {
+    size_t i = args.find('"');
+    if (i == std::string::npos)
+      error("missing string");
+    for (i++; i < args.size() && args[i] != '"'; i++) {
+      char c = args[i];
+      if (c == '\\' && i + 1 < args.size()) {
+        c = args[++i];
+        if (c == 'n')
+          c = '\n';
+        else if (c == 't')
+          c = '\t';
+        else if (c == '0')
+          c = '\0';
+      }
+      data.push_back(c);
+    }
+    if (name == ".asciiz")
+      data.push_back(0);
+  } else {
+    error("unknown directive " + name);
+  }
+}
+
+int Simulator::parse_reg(const std::string &s)
+{
+  if (s.size() < 2 || s[0] != '$')
+    error("expected a register: " + s);
+  std::string r = s.substr(1);
+  if (isdigit((unsigned char)r[0])) {
+    int n = atoi(r.c_str());
+    if (n >= 0 && n < 32)
+      return n;
+  }
+  for (int i = 0; i < 32; i++)
+    if (r == reg_names[i])
+      return i;
+  if (r == "s8")
+    return 30;
+  error("unknown register " + s);
+  return 0;
+}
+
+bool Simulator::parse_int(const std::string &s, int32_t &v)
+{
+  if (s.empty() || !(isdigit((unsigned char)s[0]) || s[0] == '-' || s[0] == '+'))
+    return false;
+  char *end;
+  long long n = strtoll(s.c_str(), &end, 0);
+  if (*end != '\0')
+    return false;
+  v = (int32_t)n;
+  return true;
+}
+
+void Simulator::instruction(const std::string &name, const std::vector<std::string> &ops)
+{
+  const OpInfo *info = NULL;
+  for (const OpInfo &i : op_infos)
+    if (name == i.name)
+      info = &i;
+  if (info == NULL)
+    error("unknown instruction " + name);
+
+  static const size_t arity[] = {2, 2, 2, 2, 3, 3, 3, 2, 1, 1, 0};
+  if (ops.size() != arity[info->form])
+    error("wrong number of operands for " + name);
+
+  Insn in;
+  in.op = info->op;
+  in.rd = in.rs = in.rt = 0;
+  in.imm = 0;
+  in.target = 0;
+  in.line = line;
+
+  switch (info->form) {
+  case F_MEM: {
+    in.rd = parse_reg(ops[0]);
+    size_t paren = ops[1].find('(');
+    if (paren == std::string::npos || ops[1].back() != ')')
+      error("expected offset(register): " + ops[1]);
+    if (paren > 0 && !parse_int(ops[1].substr(0, paren), in.imm))
+      error("bad offset " + ops[1]);
+    in.rs = parse_reg(ops[1].substr(paren + 1, ops[1].size() - paren - 2));
+    break;
+  }
+  case F_ADDR:
+    in.rd = parse_reg(ops[0]);
+    in.label = ops[1];
+    break;
+  case F_IMM:
+    in.rd = parse_reg(ops[0]);
+    if (!parse_int(ops[1], in.imm))
+      error("bad immediate " + ops[1]);
+    break;
+  case F_RR:
+    in.rd = parse_reg(ops[0]);
+    in.rs = parse_reg(ops[1]);
+    break;
+  case F_RRR:
+    in.rd = parse_reg(ops[0]);
+    in.rs = parse_reg(ops[1]);
+    if (parse_int(ops[2], in.imm))
+      in.rt = -1;
+    else
+      in.rt = parse_reg(ops[2]);
+    break;
+  case F_RRI:
+    in.rd = parse_reg(ops[0]);
+    in.rs = parse_reg(ops[1]);
+    if (!parse_int(ops[2], in.imm))
+      error("bad immediate " + ops[2]);
+    break;
+  case F_BR2:
+    in.rs = parse_reg(ops[0]);
+    if (parse_int(ops[1], in.imm))
+      in.rt = -1;
+    else
+      in.rt = parse_reg(ops[1]);
+    in.label = ops[2];
+    break;
+  case F_BR1:
+    in.rs = parse_reg(ops[0]);
+    in.label = ops[1];
+    break;
+  case F_LABEL:
+    in.label = ops[0];
+    break;
+  case F_REG:
+    in.rs = parse_reg(ops[0]);
+    break;
+  case F_NONE:
+    break;
+  }
+  text.push_back(in);
+}
+
+void Simulator::resolve()
+{
+  for (Insn &in : text) {
+    if (in.label.empty())
+      continue;
+    std::map<std::string, uint32_t>::iterator it = symbols.find(in.label);
+    if (it == symbols.end()) {
+      std::cerr << "mipsim: undefined label " << in.label << " at line " << in.line
+                << std::endl;
+      exit(1);
+    }
+    if (in.op == OP_LA)
+      in.imm = it->second;
+    else
+      in.target = it->second;
+  }
+  for (auto &fixup : data_fixups) {
+    std::map<std::string, uint32_t>::iterator it = symbols.find(fixup.second);
+    if (it == symbols.end()) {
+      std::cerr << "mipsim: undefined label " << fixup.second << std::endl;
+      exit(1);
+    }
+    uint32_t off = fixup.first - DATA_BASE;
+    for (int i = 0; i < 4; i++)
+      data[off + i] = it->second >> (8 * i);
+  }
+  align_data(8);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// Execution
+//
+//////////////////////////////////////////////////////////////////////
+
+void Simulator::fault(const char *msg)
+{
+  fflush(stdout);
+  fprintf(stderr, "mipsim: %s at 0x%08x", msg, pc);
+  if (pc >= TEXT_BASE && pc < TEXT_BASE + 4 * text.size())
+    fprintf(stderr, " (line %d)", text[(pc - TEXT_BASE) / 4].line);
+  fprintf(stderr, "\n");
+  finish(1);
+}
+
+uint8_t *Simulator::addr(uint32_t a, int size)
+{
+  if (a % size)
+    fault("unaligned access");
+  if (a >= DATA_BASE && a - DATA_BASE + size <= data.size())
+    return &data[a - DATA_BASE];
+  uint32_t stack_base = STACK_END - STACK_SIZE;
+  if (a >= stack_base && a - stack_base + size <= STACK_SIZE)
+    return &stack[a - stack_base];
+  fault("bad address");
+  return NULL;
+}
+
+int32_t Simulator::load(uint32_t a)
+{
+  uint8_t *p = addr(a, 4);
+  return (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+void Simulator::store(uint32_t a, int32_t v)
+{
+  uint8_t *p = addr(a, 4);
+  for (int i = 0; i < 4; i++)
+    p[i] = (uint32_t)v >> (8 * i);
+}
+
+void Simulator::run()
+{
+  pc = symbols["__start"];
+  regs[R_SP] = STACK_TOP;
+  for (;;) {
+    if (pc >= NATIVE_BASE && pc < NATIVE_BASE + 4 * natives.size()) {
+      (this->*natives[(pc - NATIVE_BASE) / 4])();
+      pc = regs[R_RA];
+    } else {
+      step();
+    }
+  }
+}
+
+void Simulator::step()
+{
+  if (pc < TEXT_BASE || pc >= TEXT_BASE + 4 * text.size() || pc % 4)
+    fault("jump outside the text segment");
+  const Insn &in = text[(pc - TEXT_BASE) / 4];
+  uint32_t next = pc + 4;
+  int32_t *r = regs;
+  int32_t x = r[in.rs];
+  // the second operand: a register or, for rt < 0, an immediate
+  int32_t y = in.rt >= 0 ? r[in.rt] : in.imm;
+  int64_t wide;
+  int32_t d = 0;
+  bool writes = true;
+  bool taken = false;
+
+  n_insns++;
+  switch (in.op) {
+  case OP_LW:
+    d = load(x + in.imm);
+    n_loads++;
+    break;
+  case OP_LB:
+    d = (int8_t)*addr(x + in.imm, 1);
+    n_loads++;
+    break;
+  case OP_SW:
+    store(x + in.imm, r[in.rd]);
+    n_stores++;
+    writes = false;
+    break;
+  case OP_SB:
+    *addr(x + in.imm, 1) = r[in.rd];
+    n_stores++;
+    writes = false;
+    break;
+  case OP_LA:
+  case OP_LI:
+    d = in.imm;
+    break;
+  case OP_LUI:
+    d = (uint32_t)in.imm << 16;
+    break;
+  case OP_MOVE:
+    d = x;
+    break;
+  case OP_ADD:
+  case OP_ADDI:
+    y = in.op == OP_ADDI ? in.imm : y;
+    wide = (int64_t)x + y;
+    if (wide != (int32_t)wide)
+      fault("arithmetic overflow");
+    d = wide;
+    break;
+  case OP_SUB:
+    wide = (int64_t)x - y;
+    if (wide != (int32_t)wide)
+      fault("arithmetic overflow");
+    d = wide;
+    break;
+  case OP_NEG:
+    if (x == INT32_MIN)
+      fault("arithmetic overflow");
+    d = -x;
+    break;
+  case OP_ADDU: d = (uint32_t)x + (uint32_t)y; break;
+  case OP_ADDIU: d = (uint32_t)x + (uint32_t)in.imm; break;
+  case OP_SUBU: d = (uint32_t)x - (uint32_t)y; break;
+  case OP_NEGU: d = -(uint32_t)x; break;
+  case OP_MUL: d = (uint32_t)x * (uint32_t)y; break;
+  case OP_DIV:
+  case OP_REM:
+    if (y == 0)
+      fault("division by zero");
+    if (y == -1)
+      d = in.op == OP_DIV ? -(uint32_t)x : 0;
+    else
+      d = in.op == OP_DIV ? x / y : x % y;
+    break;
+  case OP_AND: d = x & y; break;
+  case OP_OR: d = x | y; break;
+  case OP_XOR: d = x ^ y; break;
+  case OP_NOR: d = ~(x | y); break;
+  case OP_NOT: d = ~x; break;
+  case OP_ANDI: d = x & (uint16_t)in.imm; break;
+  case OP_ORI: d = x | (uint16_t)in.imm; break;
+  case OP_XORI: d = x ^ (uint16_t)in.imm; break;
+  case OP_SLL: d = (uint32_t)x << (in.imm & 31); break;
+  case OP_SRL: d = (uint32_t)x >> (in.imm & 31); break;
+  case OP_SRA: d = x >> (in.imm & 31); break;
+  case OP_SLLV: d = (uint32_t)x << (y & 31); break;
+  case OP_SRLV: d = (uint32_t)x >> (y & 31); break;
+  case OP_SRAV: d = x >> (y & 31); break;
+  case OP_SLT: d = x < y; break;
+  case OP_SLTU: d = (uint32_t)x < (uint32_t)y; break;
+  case OP_SLTI: d = x < in.imm; break;
+  case OP_SLTIU: d = (uint32_t)x < (uint32_t)in.imm; break;
+  case OP_SLE: d = x <= y; break;
+  case OP_SGT: d = x > y; break;
+  case OP_SGE: d = x >= y; break;
+  case OP_SEQ: d = x == y; break;
+  case OP_SNE: d = x != y; break;
+  case OP_BEQ:
+  case OP_BNE:
+  case OP_BLT:
+  case OP_BLE:
+  case OP_BGT:
+  case OP_BGE:
+    writes = false;
+    switch (in.op) {
+    case OP_BEQ: taken = x == y; break;
+    case OP_BNE: taken = x != y; break;
+    case OP_BLT: taken = x < y; break;
+    case OP_BLE: taken = x <= y; break;
+    case OP_BGT: taken = x > y; break;
+    default: taken = x >= y; break;
+    }
+    break;
+  case OP_BEQZ: taken = x == 0; writes = false; break;
+  case OP_BNEZ: taken = x != 0; writes = false; break;
+  case OP_BLTZ: taken = x < 0; writes = false; break;
+  case OP_BLEZ: taken = x <= 0; writes = false; break;
+  case OP_BGTZ: taken = x > 0; writes = false; break;
+  case OP_BGEZ: taken = x >= 0; writes = false; break;
+  case OP_B:
+  case OP_J:
+    taken = true;
+    writes = false;
+    break;
+  case OP_JAL:
+    r[R_RA] = next;
+    next = in.target;
+    n_calls++;
+    writes = false;
+    break;
+  case OP_JALR:
+    r[R_RA] = next;
+    next = x;
+    n_calls++;
+    writes = false;
+    break;
+  case OP_JR:
+    next = x;
+    n_jumps++;
+    writes = false;
+    break;
+  case OP_SYSCALL:
+    syscall();
+    writes = false;
+    break;
+  case OP_NOP:
+    writes = false;
+    break;
+  }
+
+  if (taken) {
+    next = in.target;
+    n_jumps++;
+  }
+  if (writes && in.rd == R_GP && d > r[R_GP]) {
+    n_allocs++;
+    n_alloc_bytes += d - r[R_GP];
+  }
+  if (writes && in.rd != R_ZERO)
+    r[in.rd] = d;
+  pc = next;
+}
+
+void Simulator::syscall()
+{
+  switch (regs[R_V0]) {
+  case 1:
+    printf("%d", regs[R_A0]);
+    break;
+  case 4:
+    for (uint32_t a = regs[R_A0]; *addr(a, 1); a++)
+      putchar(*addr(a, 1));
+    break;
+  case 5: {
+    bool eof;
+    regs[R_V0] = atoi(read_line(eof).c_str());
+    break;
+  }
+  case 9:
+    regs[R_V0] = alloc(regs[R_A0]);
+    break;
+  case 10:
+    finish(0);
+    break;
+  case 11:
+    putchar(regs[R_A0]);
+    break;
+  case 17:
+    finish(regs[R_A0]);
+    break;
+  default:
+    fault("unknown syscall");
+  }
+}
+
+void Simulator::finish(int status)
+{
+  fflush(stdout);
+  fprintf(stderr,
+          "mipsim: %lld instructions, %lld loads, %lld stores, %lld jumps, %lld calls\n"
+          "mipsim: %lld allocations, %lld bytes\n",
+          n_insns, n_loads, n_stores, n_jumps, n_calls, n_allocs, n_alloc_bytes);
+  exit(status);
+}
+
+//////////////////////////////////////////////////////////////////////
+//
+// The runtime
+//
+// Methods take self in $a0 and their arguments on the stack, the
+// first one deepest, pop the arguments and return their result in
+// $a0.  The other routines take their operands in registers as the
+// trap handler's do.
+//
+//////////////////////////////////////////////////////////////////////
+
+uint32_t Simulator::symbol(const char *name)
+{
+  std::map<std::string, uint32_t>::iterator it = symbols.find(name);
+  if (it == symbols.end()) {
+    fprintf(stderr, "mipsim: the runtime needs %s\n", name);
+    finish(1);
+  }
+  return it->second;
+}
+
+uint32_t Simulator::alloc(uint32_t bytes)
+{
+  if (check_roots)
+    check_stack();
+  bytes = (bytes + 7) & ~7u;
+  if ((uint32_t)regs[R_GP] + bytes > (uint32_t)regs[R_S7]) {
+    data.resize(regs[R_GP] - DATA_BASE + std::max(bytes, (uint32_t)HEAP_CHUNK));
+    regs[R_S7] = DATA_BASE + data.size();
+  }
+  uint32_t a = regs[R_GP];
+  regs[R_GP] += bytes;
+  n_allocs++;
+  n_alloc_bytes += bytes;
+  return a;
+}
+
+uint32_t Simulator::copy(uint32_t obj)
+{
+  uint32_t bytes = load(obj + 4 * SIZE_OFFSET) * 4;
+  // the garbage collector tag before the object is copied too
+  uint32_t c = alloc(bytes + 4) + 4;
+  addr(obj - 4, 4);
+  addr(obj + bytes - 4, 4);
+  memmove(addr(c - 4, 4), &data[obj - 4 - DATA_BASE], bytes + 4);
+  return c;
+}
+
+// Argument k of a method with nargs arguments.
+int32_t Simulator::arg(int k, int nargs)
+{
+  return load(regs[R_SP] + 4 * (nargs - k));
+}
+
+std::string Simulator::str_chars(uint32_t s)
+{
+  int32_t len = load(load(s + 4 * DEFAULT_OBJFIELDS) + 4 * DEFAULT_OBJFIELDS);
+  std::string chars;
+  for (int32_t i = 0; i < len; i++)
+    chars += *addr(s + 4 * (DEFAULT_OBJFIELDS + 1) + i, 1);
+  return chars;
+}
+
+uint32_t Simulator::new_int(int32_t val)
+{
+  uint32_t i = copy(symbol("Int_protObj"));
+  store(i + 4 * DEFAULT_OBJFIELDS, val);
+  return i;
+}
+
+uint32_t Simulator::new_string(const std::string &chars)
+{
+  uint32_t len = new_int(chars.size());
+  uint32_t words = DEFAULT_OBJFIELDS + 1 + (chars.size() + 4) / 4;
+  uint32_t s = alloc(4 * words + 4) + 4;
+  uint32_t proto = symbol("String_protObj");
+  store(s - 4, -1);
+  store(s + 4 * TAG_OFFSET, load(proto + 4 * TAG_OFFSET));
+  store(s + 4 * SIZE_OFFSET, words);
+  store(s + 4 * DISPTABLE_OFFSET, load(proto + 4 * DISPTABLE_OFFSET));
+  store(s + 4 * DEFAULT_OBJFIELDS, len);
+  for (size_t i = 0; i < chars.size(); i++)
+    *addr(s + 4 * (DEFAULT_OBJFIELDS + 1) + i, 1) = chars[i];
+  return s;
+}
+
+std::string Simulator::class_name(uint32_t obj)
+{
+  uint32_t tab = symbol("class_nameTab");
+  return str_chars(load(tab + 4 * load(obj + 4 * TAG_OFFSET)));
+}
+
+// A line of input without its newline.
+std::string Simulator::read_line(bool &eof)
+{
+  std::string s;
+  int c;
+  while ((c = getchar()) != EOF && c != '\n')
+    s += c;
+  eof = c == EOF && s.empty();
+  return s;
+}
+
+void Simulator::object_abort()
+{
+  printf("Abort called from class %s\n", class_name(regs[R_A0]).c_str());
+  finish(0);
+}
+
+void Simulator::object_type_name()
+{
+  uint32_t tab = symbol("class_nameTab");
+  regs[R_A0] = load(tab + 4 * load(regs[R_A0] + 4 * TAG_OFFSET));
+}
+
+void Simulator::object_copy()
+{
+  regs[R_A0] = copy(regs[R_A0]);
+}
+
+void Simulator::io_out_string()
+{
+std::string s = str_chars(arg(0, 1));
+  fwrite(s.data(), 1, s.size(), stdout);
+  regs[R_SP] += 4;
+}
+
+void Simulator::io_out_int()
+{
+  printf("%d", load(arg(0, 1) + 4 * DEFAULT_OBJFIELDS));
+  regs[R_SP] += 4;
+}
+
+void Simulator::io_in_string()
+{
+  bool eof;
+  std::string s = read_line(eof);
+  // a line holding a NUL reads as ""
+  regs[R_A0] = new_string(s.find('\0') == std::string::npos ? s : "");
+}
+
+void Simulator::io_in_int()
+{
+  bool eof;
+  regs[R_A0] = new_int(atoi(read_line(eof).c_str()));
+}
+
+void Simulator::string_length()
+{
+  regs[R_A0] = load(regs[R_A0] + 4 * DEFAULT_OBJFIELDS);
+}
+
+void Simulator::string_concat()
+{
+  std::string s = str_chars(regs[R_A0]) + str_chars(arg(0, 1));
+  regs[R_A0] = new_string(s);
+  regs[R_SP] += 4;
+}
+
+void Simulator::string_substr()
+{
+  std::string s = str_chars(regs[R_A0]);
+  int32_t i = load(arg(0, 2) + 4 * DEFAULT_OBJFIELDS);
+  int32_t l = load(arg(1, 2) + 4 * DEFAULT_OBJFIELDS);
+  if (i < 0 || l < 0 || (int64_t)i + l > (int64_t)s.size()) {
+    printf("Index to substr is out of range\n");
+    finish(0);
+  }
+  regs[R_A0] = new_string(s.substr(i, l));
+  regs[R_SP] += 8;
+}
+
+//
+// $a0 is kept if the objects in $t1 and $t2 are equal and replaced
+// by $a1 if they are not.
+//
+void Simulator::equality_test()
+{
+  uint32_t x = regs[R_T1], y = regs[R_T2];
+  if (x == y)
+    return;
+  bool equal = false;
+  if (x != 0 && y != 0 && load(x + 4 * TAG_OFFSET) == load(y + 4 * TAG_OFFSET)) {
+    int32_t tag = load(x + 4 * TAG_OFFSET);
+    if (tag == load(symbol("_int_tag")) || tag == load(symbol("_bool_tag")))
+      equal = load(x + 4 * DEFAULT_OBJFIELDS) == load(y + 4 * DEFAULT_OBJFIELDS);
+    else if (tag == load(symbol("_string_tag")))
+      equal = str_chars(x) == str_chars(y);
+  }
+  if (!equal)
+    regs[R_A0] = regs[R_A1];
+}
+
+void Simulator::dispatch_abort()
+{
+  printf("%s:%d: Dispatch to void.\n", str_chars(regs[R_A0]).c_str(), regs[R_T1]);
+  finish(0);
+}
+
+void Simulator::case_abort()
+{
+  printf("No match in case statement for Class %s\n", class_name(regs[R_A0]).c_str());
+  finish(0);
+}
+
+void Simulator::case_abort2()
+{
+  printf("%s:%d: Match on void in case statement.\n", str_chars(regs[R_A0]).c_str(),
+         regs[R_T1]);
+  finish(0);
+}
+
+// Objects are word aligned and follow the eyecatcher, -1.
+void Simulator::check_stack()
+{
+  for (uint32_t a = regs[R_SP]; a < STACK_TOP; a += 4) {
+    uint32_t w = load(a);
+    if (w >= heap_start && w < (uint32_t)regs[R_GP] && (w % 4 || load(w - 4) != -1)) {
+      fflush(stdout);
+      fprintf(stderr, "mipsim: 0x%08x on the stack at 0x%08x points into the heap "
+              "but not at an object\n", w, a);
+      finish(1);
+    }
+  }
+}
+
+// The heap starts empty, after the data segment.
+void Simulator::gc_init()
+{
+  align_data(8);
+  regs[R_GP] = regs[R_S7] = heap_start = DATA_BASE + data.size();
+}
+
+void Simulator::gc_init_collected()
+{
+  check_roots = true;
+  gc_init();
+}
+
+void Simulator::gc_nop()
+{
+}
+
+int main(int argc, char **argv)
+{
+  if (argc != 2) {
+    std::cerr << "usage: mipsim file.s" << std::endl;
+    return 1;
+  }
+  Simulator sim;
+  sim.load_program(argv[1]);
+  sim.run();
+  return 0;
+}
@@ -0,0 +1,253 @@
+//**************************************************************
+//
+// Peephole optimizer
+//
+// The rules look at a few adjacent instructions at a time and are
+// applied until none of them matches anywhere in the method.  None of
+// them looks across a label, so code that is branched to is never
+// changed from the outside.
+//
+//**************************************************************
+
+#include <stdlib.h>
+#include <atomic>
+#include <sstream>
+#include "peephole.h"
+
+enum Rule { PUSH_POP, REDUNDANT_MOVE, BRANCH_TO_NEXT, STORE_LOAD, NUM_RULES };
+
+static const char *rule_names[NUM_RULES] =
+  {"push/pop", "redundant move", "branch to next", "load after store"};
+
+// instructions removed by each rule, by all the code generator's threads
+static std::atomic<int> removed[NUM_RULES];
+
+Insn::Insn(const std::string &line) : text(line), is_label(false)
+{
+  std::istringstream in(line);
+  in >> op;
+  if (line[0] != '\t' && !op.empty() && op[op.size() - 1] == ':') {
+    is_label = true;
+    op.erase(op.size() - 1);
+    return;
+  }
+  std::string arg;
+  while (in >> arg)
+    args.push_back(arg);
+}
+
+Insn::Insn(const std::string &o, const std::vector<std::string> &a)
+  : op(o), args(a), is_label(false)
+{
+  text = "\t" + op + "\t";
+  for (size_t i = 0; i < args.size(); i++)
+    text += (i ? " " : "") + args[i];
+}
+
+static bool is_reg(const std::string &arg)
+{
+  return !arg.empty() && arg[0] == '$';
+}
+
+static bool is_insn(const Insn &in, const char *op, size_t nargs)
+{
+  return !in.is_label && in.op == op && in.args.size() == nargs;
+}
+
+static bool is_sp_adjust(const Insn &in, int amount)
+{
+  return is_insn(in, "addiu", 3) && in.args[0] == "$sp" && in.args[1] == "$sp" &&
+         atoi(in.args[2].c_str()) == amount;
+}
+
+static bool is_branch(const Insn &in)
+{
+  static const char *branches[] =
+    {"b", "beq", "bne", "blt", "ble", "bgt", "bge", "beqz", "bnez"};
+  if (in.is_label || in.args.empty())
+    return false;
+  for (const char *b : branches)
+    if (in.op == b)
+      return true;
+  return false;
+}
+
+//
+// For the opcodes that write one register and have no other effect,
+// the register written and the registers read.  Anything else (calls,
+// stores, branches) answers false.
+//
+static bool simple_def(const Insn &in, std::string &def, std::vector<std::string> &uses)
+{
+  static const char *ops[] =
+    {"li", "la", "lw", "move", "neg", "add", "addu", "addiu", "sub", "mul",
+     "div", "xori", "slt", "sle", "seq", "sll"};
+  if (in.is_label || in.args.empty() || !is_reg(in.args[0]))
+    return false;
+  bool known = false;
+  for (const char *op : ops)
+    if (in.op == op)
+      known = true;
+  if (!known)
+    return false;
+
+  def = in.args[0];
+  uses.clear();
+  for (size_t i = 1; i < in.args.size(); i++) {
+    const std::string &arg = in.args[i];
+    size_t paren = arg.find('(');
+    if (paren != std::string::npos)
+      uses.push_back(arg.substr(paren + 1, arg.size() - paren - 2));
+    else if (is_reg(arg))
+      uses.push_back(arg);
+  }
+  return true;
+}
+
+static bool reads(const std::vector<std::string> &uses, const std::string &reg)
+{
+  for (const std::string &use : uses)
+    if (use == reg)
+      return true;
+  return false;
+}
+
+void InsnBuffer::append(const std::string &code)
+{
+  std::istringstream in(code);
+  std::string line;
+  while (std::getline(in, line))
+    if (!line.empty())
+      insns.push_back(Insn(line));
+}
+
+//
+//   sw R 0($sp); addiu $sp $sp -4; lw R2 4($sp); addiu $sp $sp 4
+//
+// pushes a value and pops it straight back: it is move R2 R.
+//
+bool InsnBuffer::push_pop(size_t i)
+{
+  if (i + 3 >= insns.size())
+    return false;
+  const Insn &push = insns[i], &pop = insns[i + 2];
+  if (!is_insn(push, "sw", 2) || push.args[1] != "0($sp)" ||
+      !is_sp_adjust(insns[i + 1], -4) ||
+      !is_insn(pop, "lw", 2) || pop.args[1] != "4($sp)" ||
+      !is_sp_adjust(insns[i + 3], 4))
+    return false;
+
+  std::string src = push.args[0], dest = pop.args[0];
+  insns.erase(insns.begin() + i, insns.begin() + i + 4);
+  if (src == dest) {
+    removed[PUSH_POP] += 4;
+  } else {
+    insns.insert(insns.begin() + i, Insn("move", {dest, src}));
+    removed[PUSH_POP] += 3;
+  }
+  return true;
+}
+
+//
+// move X X does nothing, and neither does move B A right after
+// move A B.  A value computed into D only to be moved into R is
+// computed into R directly if the next instruction overwrites D
+// without reading it:
+//
+//   lw D 0($fp); move R D; li D 1   =>   lw R 0($fp); li D 1
+//
+bool InsnBuffer::redundant_move(size_t i)
+{
+  Insn &in = insns[i];
+  if (is_insn(in, "move", 2) && in.args[0] == in.args[1]) {
+    insns.erase(insns.begin() + i);
+    removed[REDUNDANT_MOVE]++;
+    return true;
+  }
+  if (i + 1 >= insns.size())
+    return false;
+
+  const Insn &next = insns[i + 1];
+  if (is_insn(in, "move", 2) && is_insn(next, "move", 2) &&
+      next.args[0] == in.args[1] && next.args[1] == in.args[0]) {
+    insns.erase(insns.begin() + i + 1);
+    removed[REDUNDANT_MOVE]++;
+    return true;
+  }
+
+  std::string def, later_def;
+  std::vector<std::string> uses, later_uses;
+  if (i + 2 >= insns.size() || !simple_def(in, def, uses) ||
+      !is_insn(next, "move", 2) || next.args[1] != def || next.args[0] == def ||
+      !simple_def(insns[i + 2], later_def, later_uses) ||
+      later_def != def || reads(later_uses, def))
+    return false;
+
+  std::vector<std::string> args = in.args;
+  args[0] = next.args[0];
+  in = Insn(in.op, args);
+  insns.erase(insns.begin() + i + 1);
+  removed[REDUNDANT_MOVE]++;
+  return true;
+}
+
+// A branch to the label that follows it.
+bool InsnBuffer::branch_to_next(size_t i)
+{
+  if (!is_branch(insns[i]))
+    return false;
+  const std::string &target = insns[i].args.back();
+  for (size_t j = i + 1; j < insns.size() && insns[j].is_label; j++)
+    if (insns[j].op == target) {
+      insns.erase(insns.begin() + i);
+      removed[BRANCH_TO_NEXT]++;
+      return true;
+    }
+  return false;
+}
+
+//
+// A load from the word just stored reads the register that was
+// stored instead.
+//
+bool InsnBuffer::store_load(size_t i)
+{
+  if (i + 1 >= insns.size())
+    return false;
+  const Insn &store = insns[i], &load = insns[i + 1];
+  if (!is_insn(store, "sw", 2) || !is_insn(load, "lw", 2) || store.args[1] != load.args[1])
+    return false;
+
+  std::string src = store.args[0], dest = load.args[0];
+  if (src == dest)
+    insns.erase(insns.begin() + i + 1);
+  else
+    insns[i + 1] = Insn("move", {dest, src});
+  removed[STORE_LOAD]++;
+  return true;
+}
+
+void InsnBuffer::peephole()
+{
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < insns.size(); i++)
+      while (i < insns.size() &&
+             (push_pop(i) || redundant_move(i) || branch_to_next(i) || store_load(i)))
+        changed = true;
+  }
+}
+
+void InsnBuffer::print(std::ostream &s)
+{
+  for (const Insn &in : insns)
+    s << in.text << std::endl;
+}
+
+void print_peephole_stats(std::ostream &s)
+{
+  for (int r = 0; r < NUM_RULES; r++)
+    s << "peephole " << rule_names[r] << ": " << removed[r]
+      << " instructions removed" << std::endl;
+}
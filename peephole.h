@@ -0,0 +1,51 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////
+//
+//  Instruction buffer
+//
+//  The code for a method is collected here instead of being written
+//  straight to the output, so that a peephole pass can clean it up
+//  first.  Each line of assembly appended becomes one Insn: either a
+//  label or an opcode with its operands.  An Insn keeps the text it
+//  was emitted as and is printed back verbatim unless a rule
+//  rewrites it.
+//
+//////////////////////////////////////////////////////////////////////
+
+struct Insn
+{
+  std::string text;               // the line as emitted
+  std::string op;                 // opcode, or the name of a label
+  std::vector<std::string> args;  // operands
+  bool is_label;
+
+  Insn(const std::string &line);
+  Insn(const std::string &op, const std::vector<std::string> &args);
+};
+
+class InsnBuffer
+{
+private:
+  std::vector<Insn> insns;
+
+  bool push_pop(size_t i);
+  bool redundant_move(size_t i);
+  bool branch_to_next(size_t i);
+  bool store_load(size_t i);
+
+public:
+  void append(const std::string &code);
+  void peephole();
+  void print(std::ostream &s);
+};
+
+// Report how many instructions each peephole rule has removed.
+void print_peephole_stats(std::ostream &s);
+
+#endif
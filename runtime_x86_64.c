@@ -0,0 +1,405 @@
+/*
+ * Runtime for programs compiled by cgen for x86-64 (COOL_TARGET=x86_64),
+ * in place of the trap handler SPIM loads.  See cgen_x86_64.cc for the
+ * object layout and calling convention.
+ *
+ *    gcc -o prog prog.s runtime_x86_64.c
+ *
+ * The methods of the basic classes and the routines the generated code
+ * calls are assembly stubs at the end of this file that move their
+ * operands into place for the C functions doing the work.  Objects are
+ * allocated from chunks of HEAP_CHUNK bytes got from malloc, and never
+ * freed.  cool_heap_ptr is the next free byte of the current chunk and
+ * cool_heap_limit its end, so that the generated code can allocate by
+ * bumping cool_heap_ptr, calling Object.copy only when the chunk is
+ * used up.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct object {
+  int64_t tag;
+  int64_t size;           /* in words, header included */
+  void **disp;
+  int64_t attr[];
+} object;
+
+/* defined by the generated code */
+extern object Int_protObj, String_protObj;
+extern object *class_nameTab[];
+extern int64_t _int_tag, _bool_tag, _string_tag;
+
+void cool_run_main(void);
+
+/* the value of an Int or Bool is the low half of its attribute */
+static int32_t int_value(object *o)
+{
+  return (int32_t)o->attr[0];
+}
+
+static int32_t str_len(object *s)
+{
+  return int_value((object *)s->attr[0]);
+}
+
+static char *str_chars(object *s)
+{
+  return (char *)&s->attr[1];
+}
+
+#define HEAP_CHUNK (1 << 20)
+
+char *cool_heap_ptr, *cool_heap_limit;
+
+static void *xmalloc(size_t bytes)
+{
+  void *p = malloc(bytes);
+  if (p == NULL) {
+    fputs("Out of memory\n", stderr);
+    exit(1);
+  }
+  return p;
+}
+
+static void *allocate(size_t bytes)
+{
+  bytes = (bytes + 7) & ~(size_t)7;
+  if (bytes > (size_t)(cool_heap_limit - cool_heap_ptr)) {
+    size_t chunk = bytes > HEAP_CHUNK ? bytes : HEAP_CHUNK;
+    cool_heap_ptr = xmalloc(chunk);
+    cool_heap_limit = cool_heap_ptr + chunk;
+  }
+  void *p = cool_heap_ptr;
+  cool_heap_ptr += bytes;
+  return p;
+}
+
+static object *new_int(int32_t val)
+{
+  object *o = allocate(Int_protObj.size * 8);
+  memcpy(o, &Int_protObj, Int_protObj.size * 8);
+  o->attr[0] = (uint32_t)val;
+  return o;
+}
+
+static object *new_string(const char *chars, size_t len)
+{
+  size_t size = 4 + (len + 8) / 8;
+  object *s = allocate(size * 8);
+  memcpy(s, &String_protObj, 3 * 8);
+  s->size = size;
+  s->attr[0] = (int64_t)new_int(len);
+  memcpy(str_chars(s), chars, len);
+  str_chars(s)[len] = '\0';
+  return s;
+}
+
+/* a line of input without its newline; NULL at end of file */
+static char *read_line(size_t *len)
+{
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t n = getline(&line, &cap, stdin);
+  if (n < 0) {
+    free(line);
+    return NULL;
+  }
+  if (n > 0 && line[n - 1] == '\n')
+    line[--n] = '\0';
+  *len = n;
+  return line;
+}
+
+static void finish(void)
+{
+  fflush(stdout);
+  exit(0);
+}
+
+object *cool_copy(object *o)
+{
+  object *c = allocate(o->size * 8);
+  memcpy(c, o, o->size * 8);
+  return c;
+}
+
+void cool_abort(object *self)
+{
+  printf("Abort called from class %s\n", str_chars(class_nameTab[self->tag]));
+  finish();
+}
+
+object *cool_type_name(object *self)
+{
+  return class_nameTab[self->tag];
+}
+
+void cool_out_string(object *s)
+{
+  fwrite(str_chars(s), 1, str_len(s), stdout);
+}
+
+void cool_out_int(object *i)
+{
+  printf("%d", int_value(i));
+}
+
+void cool_print_int(int64_t val)
+{
+  printf("%d", (int32_t)val);
+}
+
+object *cool_in_string(void)
+{
+  size_t len;
+  char *line = read_line(&len);
+  object *s;
+  if (line == NULL || strlen(line) != len)
+    s = new_string("", 0);       /* a line holding a NUL reads as "" */
+  else
+    s = new_string(line, len);
+  free(line);
+  return s;
+}
+
+object *cool_in_int(void)
+{
+  size_t len;
+  char *line = read_line(&len);
+  object *i = new_int(line ? atoi(line) : 0);
+  free(line);
+  return i;
+}
+
+object *cool_length(object *s)
+{
+  return (object *)s->attr[0];
+}
+
+object *cool_concat(object *s, object *t)
+{
+  size_t n = str_len(s), m = str_len(t);
+  char *chars = xmalloc(n + m + 1);
+  memcpy(chars, str_chars(s), n);
+  memcpy(chars + n, str_chars(t), m);
+  object *r = new_string(chars, n + m);
+  free(chars);
+  return r;
+}
+
+object *cool_substr(object *s, object *i, object *l)
+{
+  int64_t start = int_value(i), len = int_value(l);
+  if (start < 0 || len < 0 || start + len > str_len(s)) {
+    printf("Index to substr is out of range\n");
+    finish();
+  }
+  return new_string(str_chars(s) + start, len);
+}
+
+int64_t cool_equal(object *x, object *y)
+{
+  if (x == y)
+    return 1;
+  if (x == NULL || y == NULL || x->tag != y->tag)
+    return 0;
+  if (x->tag == _int_tag || x->tag == _bool_tag)
+    return int_value(x) == int_value(y);
+  if (x->tag == _string_tag)
+    return str_len(x) == str_len(y) &&
+           memcmp(str_chars(x), str_chars(y), str_len(x)) == 0;
+  return 0;
+}
+
+void cool_dispatch_abort(object *filename, int64_t line)
+{
+  printf("%s:%d: Dispatch to void.\n", str_chars(filename), (int)line);
+  finish();
+}
+
+void cool_case_abort(object *o)
+{
+  printf("No match in case statement for Class %s\n", str_chars(class_nameTab[o->tag]));
+  finish();
+}
+
+void cool_case_abort2(object *filename, int64_t line)
+{
+  printf("%s:%d: Match on void in case statement.\n", str_chars(filename), (int)line);
+  finish();
+}
+
+void cool_overflow_abort(object *filename, int64_t line)
+{
+  printf("%s:%d: Arithmetic overflow.\n", str_chars(filename), (int)line);
+  finish();
+}
+
+void cool_divide_abort(object *filename, int64_t line)
+{
+  printf("%s:%d: Division by zero.\n", str_chars(filename), (int)line);
+  finish();
+}
+
+int main(void)
+{
+  cool_run_main();
+  printf("\nCOOL program successfully executed\n");
+  return 0;
+}
+
+/*
+ * C_CALL(f) calls f with the stack aligned as the C ABI wants, from
+ * code that doesn't keep it aligned: it saves %rsp above the aligned
+ * stack pointer and restores it after the call.
+ */
+#define C_CALL(f) \
+  "\tpushq\t%rsp\n" \
+  "\tpushq\t(%rsp)\n" \
+  "\tandq\t$-16, %rsp\n" \
+  "\tcall\t" #f "\n" \
+  "\tmovq\t8(%rsp), %rsp\n"
+
+__asm__(
+  "\t.text\n"
+
+  /* methods: receiver in %rax, arguments on the stack, popped here */
+  "\t.globl\tObject.abort\n"
+  "Object.abort:\n"
+  "\tmovq\t%rax, %rdi\n"
+  C_CALL(cool_abort)
+
+  "\t.globl\tObject.type_name\n"
+  "Object.type_name:\n"
+  "\tmovq\t%rax, %rdi\n"
+  C_CALL(cool_type_name)
+  "\tret\n"
+
+  "\t.globl\tObject.copy\n"
+  "Object.copy:\n"
+  "\tmovq\t%rax, %rdi\n"
+  C_CALL(cool_copy)
+  "\tret\n"
+
+  "\t.globl\tIO.out_string\n"
+  "IO.out_string:\n"
+  "\tpushq\t%rax\n"
+  "\tmovq\t16(%rsp), %rdi\n"
+  C_CALL(cool_out_string)
+  "\tpopq\t%rax\n"
+  "\tret\t$8\n"
+
+  "\t.globl\tIO.out_int\n"
+  "IO.out_int:\n"
+  "\tpushq\t%rax\n"
+  "\tmovq\t16(%rsp), %rdi\n"
+  C_CALL(cool_out_int)
+  "\tpopq\t%rax\n"
+  "\tret\t$8\n"
+
+  "\t.globl\tIO.in_string\n"
+  "IO.in_string:\n"
+  C_CALL(cool_in_string)
+  "\tret\n"
+
+  "\t.globl\tIO.in_int\n"
+  "IO.in_int:\n"
+  C_CALL(cool_in_int)
+  "\tret\n"
+
+  "\t.globl\tString.length\n"
+  "String.length:\n"
+  "\tmovq\t%rax, %rdi\n"
+  C_CALL(cool_length)
+  "\tret\n"
+
+  "\t.globl\tString.concat\n"
+  "String.concat:\n"
+  "\tmovq\t%rax, %rdi\n"
+  "\tmovq\t8(%rsp), %rsi\n"
+  C_CALL(cool_concat)
+  "\tret\t$8\n"
+
+  "\t.globl\tString.substr\n"
+  "String.substr:\n"
+  "\tmovq\t%rax, %rdi\n"
+  "\tmovq\t16(%rsp), %rsi\n"
+  "\tmovq\t8(%rsp), %rdx\n"
+  C_CALL(cool_substr)
+  "\tret\t$16\n"
+
+  /* operands in %r10 and %r11; 1 or 0 in %rax */
+  "\t.globl\tequality_test\n"
+  "equality_test:\n"
+  "\tmovq\t%r10, %rdi\n"
+  "\tmovq\t%r11, %rsi\n"
+  C_CALL(cool_equal)
+  "\tret\n"
+
+  /* prints %eax, preserving every other register */
+  "\t.globl\t_out_int\n"
+  "_out_int:\n"
+  "\tpushq\t%rcx\n"
+  "\tpushq\t%rdx\n"
+  "\tpushq\t%rsi\n"
+  "\tpushq\t%rdi\n"
+  "\tpushq\t%r8\n"
+  "\tpushq\t%r9\n"
+  "\tpushq\t%r10\n"
+  "\tpushq\t%r11\n"
+  "\tmovslq\t%eax, %rdi\n"
+  C_CALL(cool_print_int)
+  "\tpopq\t%r11\n"
+  "\tpopq\t%r10\n"
+  "\tpopq\t%r9\n"
+  "\tpopq\t%r8\n"
+  "\tpopq\t%rdi\n"
+  "\tpopq\t%rsi\n"
+  "\tpopq\t%rdx\n"
+  "\tpopq\t%rcx\n"
+  "\tret\n"
+
+  /* operands already in %rdi and %rsi */
+  "\t.globl\t_dispatch_abort\n"
+  "_dispatch_abort:\n"
+  C_CALL(cool_dispatch_abort)
+
+  "\t.globl\t_case_abort\n"
+  "_case_abort:\n"
+  C_CALL(cool_case_abort)
+
+  "\t.globl\t_case_abort2\n"
+  "_case_abort2:\n"
+  C_CALL(cool_case_abort2)
+
+  "\t.globl\t_overflow_abort\n"
+  "_overflow_abort:\n"
+  C_CALL(cool_overflow_abort)
+
+  "\t.globl\t_divide_abort\n"
+  "_divide_abort:\n"
+  C_CALL(cool_divide_abort)
+
+  /* called from main: new Main.main() */
+  "cool_run_main:\n"
+  "\tpushq\t%rbx\n"
+  "\tpushq\t%rbp\n"
+  "\tpushq\t%r12\n"
+  "\tpushq\t%r13\n"
+  "\tpushq\t%r14\n"
+  "\tpushq\t%r15\n"
+  "\tleaq\tMain_protObj(%rip), %rax\n"
+  "\tcall\tObject.copy\n"
+  "\tcall\tMain_init\n"
+  "\tcall\tMain.main\n"
+  "\tpopq\t%r15\n"
+  "\tpopq\t%r14\n"
+  "\tpopq\t%r13\n"
+  "\tpopq\t%r12\n"
+  "\tpopq\t%rbp\n"
+  "\tpopq\t%rbx\n"
+  "\tret\n"
+);
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Runs a program that recurses as deep as it counts, in mipsim, with
+# and without -O: a self-recursive accumulator, two methods of different
+# arity calling each other, and a walk down a linked list by dynamic
+# dispatch, all with their calls in tail position.  Without -O, when
+# calls are not made into jumps, the stack runs out.
+#
+#    make mipsim
+#    ./tailbench.sh [cgen] [depth]
+#
+CGEN=${1:-./cgen}
+DEPTH=${2:-1000000}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+trap 'rm -rf $TMP' EXIT
+
+cat > $TMP/deep.cl <<COOL
+class Cell {
+  next : Cell;
+  link(n : Cell) : Cell { { next <- n; self; } };
+  length(n : Int) : Int { if isvoid next then n + 1 else next.length(n + 1) fi };
+};
+class Main inherits IO {
+  count(n : Int, acc : Int) : Int { if n = 0 then acc else count(n - 1, acc + 1) fi };
+  even(n : Int, a : Int, b : Int) : Bool { if n = 0 then true else odd(n - 1) fi };
+  odd(n : Int) : Bool { if n = 0 then false else even(n - 1, 0, 0) fi };
+  main() : Object {
+    let list : Cell, i : Int <- 0 in {
+      while i < $DEPTH loop { list <- (new Cell).link(list); i <- i + 1; } pool;
+      out_int(count($DEPTH, 0));
+      out_string(if even($DEPTH, 0, 0) then " even " else " odd " fi);
+      out_int(list.length(0));
+      out_string("\n");
+    }
+  };
+};
+COOL
+$DIR/lexer $TMP/deep.cl | $DIR/parser | $DIR/semant > $TMP/deep.ast
+
+for opt in "" -O; do
+  echo "cgen${opt:+ $opt}:"
+  $CGEN $opt -o $TMP/deep.s < $TMP/deep.ast
+  $DIR/mipsim $TMP/deep.s 2>&1 | grep -v "successfully executed"
+done